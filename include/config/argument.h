@@ -14,6 +14,7 @@ struct ArgumentParser {
     enum class Rule {
         KeyOnly,    // Key + no value
         KeyValue,   // Key + value
+        KeyOptional,// Key + optional value
     };
 
     template <Rule rule, typename ..._Args>
@@ -24,6 +25,8 @@ struct ArgumentParser {
             return this->match_k(result, std::forward <_Args>(args)...);
         } else if constexpr (rule == Rule::KeyValue) {
             return this->match_kv(result, std::forward <_Args>(args)...);
+        } else if constexpr (rule == Rule::KeyOptional) {
+            return this->match_ko(result, std::forward <_Args>(args)...);
         } else {
             static_assert(sizeof...(_Args) + 1 == 0, "Invalid rule");
         }
@@ -68,6 +71,16 @@ struct ArgumentParser {
         }
     }
 
+    template <typename _Fn>
+    auto match_ko(_Match_Result_t result, _Fn &&fn) -> void {
+        if (result.has_value()) {
+            auto iter = result.value();
+            auto value = iter->second;
+            this->kv_map.erase(iter);
+            std::invoke(std::forward <_Fn>(fn), value);
+        }
+    }
+
     auto match_kv(_Match_Result_t result) -> std::optional <std::string_view> {
         std::optional <std::string_view> retval;
         if (result.has_value()) {
@@ -7,20 +7,27 @@
 
 namespace dark {
 
+struct AnswerChecker;
+
 struct Config {
   public:
     static auto parse(int argc, char **argv) -> std::unique_ptr <Config>;
 
     auto get_input_stream() const -> std::istream &;
-    auto get_output_stream() const -> std::ostream &;
+    // Program output goes to a file descriptor, or to the answer checker in oj-mode.
+    auto get_output_fd() const -> int;
+    auto get_answer_checker() const -> AnswerChecker *;
 
     auto get_stack_top() const -> target_size_t;
     auto get_stack_low() const -> target_size_t;
     auto get_timeout() const -> std::size_t;
+    auto get_cycle_limit() const -> std::size_t;
 
     auto get_assembly_names() const -> std::span <const std::string_view>;
 
     auto has_option(std::string_view) const -> bool;
+    // The value of an option (e.g. --cache=<value>), empty if not given.
+    auto get_option_value(std::string_view) const -> std::string_view;
     auto get_weight(std::string_view) const -> std::size_t;
 
     ~Config();
@@ -60,6 +60,18 @@ struct CounterJump {
     std::size_t jalr    {};
 };
 
+// Events of the simulated cache (see --cache), which are not commands.
+struct CounterCache {
+    std::size_t l1i_miss {};
+    std::size_t l1d_miss {};
+    std::size_t l2_miss  {};
+};
+
+// Mispredicted branches (see --predictor), which are not commands either.
+struct CounterPredictor {
+    std::size_t mispredict {};
+};
+
 struct Counter :
     CounterArith,
     CounterBitwise,
@@ -67,7 +79,9 @@ struct Counter :
     CounterMemory,
     CounterMultiply,
     CounterDivide,
-    CounterJump
+    CounterJump,
+    CounterCache,
+    CounterPredictor
 {};
 
 } // namespace dark
@@ -7,6 +7,7 @@ namespace dark::config {
 static constexpr std::size_t kInitMemorySize    = 256 * 1024 * 1024;
 static constexpr std::size_t kInitStackSize     = 32 * 1024;
 static constexpr std::size_t kInitTimeOut       = static_cast<std::size_t>(-1);
+static constexpr std::size_t kInitCycleLimit    = static_cast<std::size_t>(-1);
 static constexpr std::string_view kStdin        = "<stdin>";
 static constexpr std::string_view kStdout       = "<stdout>";
 static constexpr std::string_view kStderr       = "<stderr>";
@@ -20,11 +21,23 @@ static constexpr std::string_view kSupportedOptions[] = {
     "--detail",
     "--debug",
     "--cache",
-    "--predictor",
+    "--block",
+    "--jit",
+    "--batch",
+    "--flat",
     "--all",
     "--oj-mode",
 };
 
+// Options which may take a value, e.g. --l1d=<config>.
+static constexpr std::string_view kValueOptions[] = {
+    "--l1i",
+    "--l1d",
+    "--l2",
+    "--predictor",
+    "--poison",
+};
+
 static constexpr std::initializer_list <std::string_view> kInitAssemblyFiles = {
     "builtin.s",
     "test.s",
@@ -42,7 +55,46 @@ Options:
                                     Conflicts with --silent.
   --debug                           Use built-in gdb.
   --cache                           Enable cache simulation.
-  --predictor                       Enable branch predictor simulation.
+                                    Equivalent to --l1i --l1d --l2.
+  --l1i[=<size>:<ways>:<line>:<policy>]
+  --l1d[=<size>:<ways>:<line>:<policy>]
+  --l2[=<size>:<ways>:<line>:<policy>]
+                                    Enable a level of the cache hierarchy, with split
+                                    L1 caches (default 32K:8:64:lru) and a shared L2
+                                    (default 256K:8:64:lru). The policy is either lru
+                                    or plru. Trailing fields can be omitted.
+                                    An L1 miss costs the weight l1i_miss or l1d_miss,
+                                    and an L2 miss costs the weight l2_miss. With a data
+                                    cache, memory commands cost the hit latency of the
+                                    first data level by default: 4 with L1D, or 14 with
+                                    only L2, rather than 64. Fetches go through the
+                                    caches once per block, so --l1i and --l2 imply --block.
+                                    - Example: --l1d=16K:4 --l2=1M:16:64:plru
+  --predictor[=<kind>:<bits>:<init>]
+                                    Enable branch predictor simulation, default bimodal:12.
+                                    The kind is one of bimodal, gshare, tournament and tage,
+                                    with 2^bits entries per table. Tables start random from
+                                    a fixed seed, or from the seed given as init, or weakly
+                                    taken if init is weak. Each misprediction costs the
+                                    weight mispredict.
+                                    - Example: --predictor=gshare:12 --predictor=tage::weak
+  --block                           Execute straight-line blocks in one dispatch.
+                                    The profile is the same as the default mode.
+  --jit                             Compile hot blocks to native code (x86-64 Linux only).
+                                    Only arithmetic, lui and auipc are translated; loads,
+                                    stores and other commands call back to the interpreter,
+                                    and block ends still go through it. Implies --block.
+                                    The profile is still the same.
+  --batch                           Update counters once per block, rather than per command.
+                                    Implies --block. The profile is still the same.
+  --flat                            Map the guest memory to one flat host range (Linux only).
+                                    The profile is still the same.
+  --poison[=<policy>]               Set how often libc calls poison caller-saved registers
+                                    on return, to catch programs that break the calling
+                                    convention. The policy is full (default), off, or
+                                    sampled:<period> to poison once every period calls
+                                    (default 64). The profile is still the same.
+                                    - Example: --poison=off --poison=sampled:16
   --all                             Enable all optimizations.
                                     Equivalent to --cache --predictor.
   --oj-mode                         Settings for the online judge.
@@ -58,6 +110,9 @@ Configurations:
   -t=<time>, --time=<time>          Set maximum instructions for the simulator.
                                     Note that this time is measured by instructions, not cycles.
 
+  -c=<cycles>, --cycles=<cycles>    Set maximum cycles (by the weights above) for the simulator.
+                                    The program is stopped once it exceeds the limit.
+
   -m=<mem>, --memory=<mem>          Set memory size (bytes) for the simulator, default 256MB.
                                     We support K/M suffix for kilobytes/megabytes.
                                     - Example: -m=114K -m=514M -mem=1919 -memory=810
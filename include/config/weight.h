@@ -9,6 +9,10 @@ static constexpr std::size_t kArith     = 1;
 static constexpr std::size_t kBitwise   = 1;
 static constexpr std::size_t kBranch    = 10;
 static constexpr std::size_t kMemory    = 64;
+// With a data cache, a memory command costs the hit latency of the first data level
+// (L1D, or L2 without one), and each miss costs the weight of that cache event.
+static constexpr std::size_t kMemoryL1  = 4;
+static constexpr std::size_t kMemoryL2  = 14;
 static constexpr std::size_t kMultiply  = 4;
 static constexpr std::size_t kDivide    = 20;
 static constexpr std::size_t kManual    = 0; // Magic number
@@ -34,6 +38,12 @@ static constexpr std::string_view divide_name_list[] = {
 static constexpr std::string_view jump_name_list[] = {
     "jal = 1", "jalr = 2",
 };
+static constexpr std::string_view cache_name_list[] = {
+    "l1i_miss = 10", "l1d_miss = 10", "l2_miss = 100",
+};
+static constexpr std::string_view predictor_name_list[] = {
+    "mispredict = 20",
+};
 
 struct Weight_Range {
     using _List_t = std::span <const std::string_view>;
@@ -52,6 +62,8 @@ static constexpr Weight_Range kWeightRanges[] = {
     { "multiply", multiply_name_list, kMultiply },
     { "divide"  , divide_name_list  , kDivide   },
     { "jump"    , jump_name_list    , kManual   },
+    { "cache"   , cache_name_list   , kManual   },
+    { "predictor", predictor_name_list, kManual },
 };
 
 constexpr auto parse_manual(std::string_view name) {
@@ -1,6 +1,8 @@
 #pragma once
 #include <declarations.h>
 #include <config/counter.h>
+#include <simulation/return_stack.h>
+#include <interpreter/output.h>
 #include <iosfwd>
 #include <memory>
 
@@ -12,11 +14,56 @@ struct Device {
     } counter;
 
     std::istream &in;
-    std::ostream &out;
+    // Whether the input may wait on the output, so that output goes out before each read.
+    bool interactive;
+    // Program output, flushed in bulk (see interpreter/output.h).
+    OutputBuffer out;
+
+    // Only used to speed up dispatch of returns.
+    ReturnStack ras;
+
+    // Whether counters of block bodies are updated in batch (see --batch).
+    bool batch;
+
+    // Whether fetches and data accesses go through the simulated caches (see --cache).
+    // The line of the last fetch is kept in a buffer, which never reaches the caches.
+    // The line of the last data access is kept too. Both always hit in the first
+    // level they would go to, so hits on them are only counted here.
+    struct {
+        bool inst, data;
+        target_size_t line, bits;
+        std::size_t fetched, lines;     // Commands fetched, and lines out of the buffer.
+        target_size_t data_line, data_bits;
+        std::size_t data_hits;
+    } cache;
+
+    // Caller-saved registers are poisoned on every period-th libc return (see --poison).
+    // A period of 0 never poisons.
+    struct {
+        std::size_t period, count;
+    } poison;
 
     static auto create(const Config &config) ->std::unique_ptr<Device>;
     // Predict a branch at pc. It will call external branch predictor
     void predict(target_size_t pc, bool result);
+    // Fetch size commands from pc. Only called if cache.inst is enabled.
+    void fetch(target_size_t pc, std::size_t size) {
+        this->cache.fetched += size;
+        const auto last = (pc + size * sizeof(command_size_t) - 1) >> this->cache.bits;
+        if (last == this->cache.line && (pc >> this->cache.bits) == last) [[likely]] return;
+        return this->fetch_lines(pc, last);
+    }
+    // Load or store at addr. Only called if cache.data is enabled.
+    void access(target_size_t addr) {
+        const auto line = addr >> this->cache.data_bits;
+        if (line == this->cache.data_line) [[likely]] return void(++this->cache.data_hits);
+        this->cache.data_line = line;
+        return this->access_line(addr);
+    }
+    // Total cycles so far, by the weight of each command.
+    auto get_cycles() const -> std::size_t;
+    // The largest cost of one command, with every miss and misprediction it may cause.
+    auto get_max_weight() const -> std::size_t;
     // Print in details
     void print_details(bool) const;
 
@@ -24,6 +71,9 @@ struct Device {
   private:
     struct Impl;
 
+    void fetch_lines(target_size_t, target_size_t);
+    void access_line(target_size_t);
+
     auto get_impl() -> Impl &;
 };
 
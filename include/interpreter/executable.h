@@ -1,11 +1,18 @@
 #pragma once
 #include <interpreter/forward.h>
 #include <interpreter/hint.h>
-#include <riscv/register.h>
+#include <interpreter/register.h>
+#include <limits>
 
 namespace dark {
 
-struct Executable {
+#if defined(REIMU_THREADED)
+inline constexpr bool kThreadedDispatch = true;
+#else
+inline constexpr bool kThreadedDispatch = false;
+#endif
+
+struct alignas(16) Executable {
   private:
     [[noreturn]]
     static auto fn(Executable &, RegisterFile &, Memory &, Device &) -> Hint;
@@ -14,15 +21,23 @@ struct Executable {
     using _Func_t = decltype(fn);
     static_assert(std::same_as<_Func_t, Function_t>);
 
+    /**
+     * Registers are stored as byte offsets into the register file,
+     * so that handlers can access them without any conversion.
+     */
     struct MetaData {
         struct PackData;
-        Register rd  {};
-        Register rs1 {};
-        Register rs2 {};
+        RegisterOffset rd  {};
+        RegisterOffset rs1 {};
+        RegisterOffset rs2 {};
+        // Length of the straight-line run starting from this command.
+        std::uint8_t block {};
         std::uint32_t imm {};
         auto parse(RegisterFile &) const -> PackData;
     };
 
+    static_assert(sizeof(MetaData) == 8);
+
   private:
     static_assert(sizeof(_Func_t *) == sizeof(std::size_t));
 
@@ -30,6 +45,11 @@ struct Executable {
     MetaData    meta = {};  // Some in hand data.
 
   public:
+    /* Maximum number of commands that one block may hold. */
+    static constexpr std::size_t kMaxBlockSize = std::numeric_limits <std::uint8_t>::max();
+    /* Bytes of text covered by one ICache page. A block never crosses pages. */
+    static constexpr std::size_t kPageSize = 4096;
+
     constexpr explicit Executable() = default;
     constexpr explicit Executable(_Func_t *func, MetaData meta) : func(func), meta(meta) {}
 
@@ -47,12 +67,50 @@ struct Executable {
 
     auto &get_meta() const { return this->meta; }
 
-    /* Return the hint for the next command.  */
-    auto next(target_size_t n = 4) -> Hint {
+    auto get_handle() const -> _Func_t * { return this->func; }
+
+    /**
+     * Number of commands in the straight-line block starting here,
+     * which can be executed without any control flow in between.
+     * 0 if this command ends a block (or is not yet compiled).
+     */
+    auto get_block_size() const -> std::size_t { return this->meta.block; }
+
+    void set_block_size(std::size_t size) { this->meta.block = size; }
+
+    /**
+     * Return the hint for the next command. It may be one past
+     * the end of the ICache page, so it must be checked in ifetch.
+     */
+    auto next() -> Hint {
         static_assert(sizeof(command_size_t) == 4,
             "We assume that the size of command is 4 bytes.");
-        return n % 4 == 0 ? Hint {this + (target_ssize_t(n) >> 2)} : Hint {}; 
+        return Hint { this + 1 };
+    }
+
+    /**
+     * Return the hint for a successor which is known (at compile time)
+     * to lie in the same ICache page, so that it can be followed unchecked.
+     */
+    auto chain(target_size_t n = 4) -> Hint {
+        return Hint { this + (target_ssize_t(n) >> 2), true };
+    }
+
+    /**
+     * Return the hint for the next command in a block body.
+     * With threaded dispatch, jump to the next command of the block directly,
+     * so that the interpreter loop is only visited at block exits.
+     * The chain is no longer than kMaxBlockSize, so it is safe
+     * even if the compiler fails to turn it into a tail call.
+     */
+    auto next(RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+        if constexpr (kThreadedDispatch)
+            if (this->get_block_size() > 1) return this[1](rf, mem, dev);
+        return this->next();
     }
 };
 
+// ICache holds one per command, so four of them should fit in a cache line.
+static_assert(sizeof(Executable) == 16);
+
 } // namespace dark
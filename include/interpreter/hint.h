@@ -6,6 +6,8 @@ namespace dark {
 /** A hint of what to execute next. */
 struct Hint {
     Executable *next = nullptr;
+    // The next executable is resolved at compile time, and need no check.
+    bool direct = false;
     bool operator == (const Hint &other) const = default;
 };
 
@@ -0,0 +1,32 @@
+#pragma once
+#include <interpreter/forward.h>
+#include <memory>
+
+namespace dark {
+
+/**
+ * A tier-2 compiler for hot blocks, which emits native x86-64 code.
+ * Guest registers stay in the register file, and commands which
+ * can not be translated (e.g. load/store) call back to the handler,
+ * so that every counter is updated exactly as in the interpreter.
+ */
+struct Jit {
+    /* Return null if the JIT is not enabled or not supported. */
+    static auto create(const Config &, Memory &) -> std::unique_ptr <Jit>;
+    /**
+     * Count one execution of the block starting at exe,
+     * and run it natively if it is (or just becomes) hot.
+     * @return Whether the block has been executed.
+     */
+    bool execute(Executable &exe, std::size_t size, RegisterFile &, Memory &, Device &);
+    // Print in details
+    void print_details(bool) const;
+
+    ~Jit();
+  private:
+    struct Impl;
+
+    auto get_impl() -> Impl &;
+};
+
+} // namespace dark
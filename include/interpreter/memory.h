@@ -1,5 +1,7 @@
 #pragma once
 #include <interpreter/forward.h>
+#include <simulation/region_cache.h>
+#include <concepts>
 #include <memory>
 #include <span>
 
@@ -24,6 +26,12 @@ struct Memory {
     void store_u16(target_size_t addr, std::uint16_t value);
     void store_u32(target_size_t addr, std::uint32_t value);
 
+    // Inline fast path for load/store handlers, same as above.
+    template <std::integral _Int>
+    auto load(target_size_t addr) -> _Int;
+    template <std::unsigned_integral _Int>
+    void store(target_size_t addr, _Int value);
+
     // For malloc use.
     [[nodiscard]]
     auto sbrk(target_ssize_t) -> std::pair <char *, target_size_t>;
@@ -36,10 +44,34 @@ struct Memory {
 
     ~Memory();
 
-    void print_details(bool) const;
+    void print_details(bool, const Device &) const;
   private:
     struct Impl;
     Impl &get_impl();
+
+    RegionCache cache;
+
+    // Miss in the cache, which also reports any error.
+    template <std::integral _Int>
+    [[gnu::cold]] auto load_slow(target_size_t) -> _Int;
+    template <std::unsigned_integral _Int>
+    [[gnu::cold]] void store_slow(target_size_t, _Int);
 };
 
+template <std::integral _Int>
+inline auto Memory::load(target_size_t addr) -> _Int {
+    if (addr % alignof(_Int) == 0)
+        if (auto *ptr = this->cache.find(addr, sizeof(_Int)))
+            return *reinterpret_cast <_Int *> (ptr);
+    return this->load_slow <_Int> (addr);
+}
+
+template <std::unsigned_integral _Int>
+inline void Memory::store(target_size_t addr, _Int value) {
+    if (addr % alignof(_Int) == 0)
+        if (auto *ptr = this->cache.find(addr, sizeof(_Int)))
+            return void(*reinterpret_cast <_Int *> (ptr) = value);
+    return this->store_slow <_Int> (addr, value);
+}
+
 } // namespace dark
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+namespace dark {
+
+struct AnswerChecker;
+
+/**
+ * The output of the program, kept in a large contiguous host buffer.
+ * The buffer is either flushed in bulk to a file descriptor, or checked
+ * against the answer in oj-mode, which panics on a wrong answer.
+ * Anything left is flushed on destruction, where nothing panics.
+ */
+struct OutputBuffer {
+  public:
+    explicit OutputBuffer(int fd);
+    explicit OutputBuffer(AnswerChecker &checker);
+    OutputBuffer(const OutputBuffer &) = delete;
+    auto operator=(const OutputBuffer &) -> OutputBuffer & = delete;
+    ~OutputBuffer();
+
+    void put(char c) {
+        if (this->cursor == this->finish) [[unlikely]] this->flush();
+        *this->cursor++ = c;
+    }
+
+    void write(std::string_view str) {
+        if (str.size() > std::size_t(this->finish - this->cursor)) [[unlikely]]
+            return this->write_slow(str);
+        std::memcpy(this->cursor, str.data(), str.size());
+        this->cursor += str.size();
+    }
+
+    void flush();
+    // Empty the buffer without panicking, and return false only on a wrong answer.
+    bool drain();
+
+  private:
+    static constexpr std::size_t kBufferSize = std::size_t(1) << 16;
+
+    char *start;
+    char *cursor;
+    char *finish;
+
+    int const fd;                       // -1 if checked.
+    AnswerChecker *const checker;       // Only used if checked.
+    std::unique_ptr <char[]> storage;
+
+    void write_slow(std::string_view);
+};
+
+} // namespace dark
@@ -2,9 +2,18 @@
 #include <declarations.h>
 #include <riscv/register.h>
 #include <array>
+#include <cstddef>
 
 namespace dark {
 
+/* A register, pre-scaled to its byte offset in the register file. */
+struct RegisterOffset {
+    std::uint8_t value {};
+    constexpr RegisterOffset() = default;
+    constexpr RegisterOffset(Register reg)
+        : value(reg_to_int(reg) * sizeof(target_size_t)) {}
+};
+
 struct RegisterFile {
   private:
     std::array <target_size_t, 32> regs;
@@ -19,15 +28,23 @@ struct RegisterFile {
     explicit RegisterFile(target_size_t, const Config &);
     /* Return reference to given register. */
     auto &operator[](Register reg) { return this->regs[reg_to_int(reg)]; }
+    /* Return reference to given register, without any scaling. */
+    auto &operator[](RegisterOffset reg) {
+        auto *base = reinterpret_cast <std::byte *> (this->regs.data());
+        return *reinterpret_cast <target_size_t *> (base + reg.value);
+    }
     /* Return old program counter. */
     auto get_pc() const { return this->pc; }
     /* Set new program counter. */
     void set_pc(target_size_t pc) { this->new_pc = pc; }
-    /* Complete after one instruction. */
+    /**
+     * Complete after one instruction.
+     * The zero register is never written (see simulation/executable.h),
+     * so there is no need to reset it here.
+     */
     bool advance() {
         this->pc = this->new_pc;
         this->new_pc = this->pc + sizeof(command_size_t);
-        (*this)[Register::zero] = 0;
         return this->pc != this->end_pc;
     }
     /* Print register details. */
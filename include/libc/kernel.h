@@ -0,0 +1,300 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace dark::libc::__details {
+
+/**
+ * Bounded string kernels over guest memory on the host. They go a block
+ * of chunks at a time, then a chunk at a time, and the bytes left are
+ * handled one by one, so that nothing past the bound is ever touched.
+ *
+ * Each instruction set provides the chunk operations below, which only
+ * take pointers, so that no vector is passed across a call.
+ */
+namespace kernel {
+
+#if defined(__x86_64__)
+
+struct SSE2 {
+    static constexpr std::size_t kChunk = 16;
+    static constexpr std::size_t kBlock = 4 * kChunk;
+
+    static auto load(const char *ptr) -> __m128i {
+        return _mm_loadu_si128(reinterpret_cast <const __m128i *> (ptr));
+    }
+    // Zero where the byte is zero.
+    static auto as_zero(const char *ptr) -> __m128i {
+        return load(ptr);
+    }
+    // Zero where the byte of lhs is zero, or differs from rhs.
+    static auto as_zero(const char *lhs, const char *rhs) -> __m128i {
+        const auto data = load(lhs);
+        return _mm_min_epu8(data, _mm_cmpeq_epi8(data, load(rhs)));
+    }
+    static auto zero_mask(__m128i data) -> unsigned {
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(data, _mm_setzero_si128()));
+    }
+    static bool any_zero(__m128i c0, __m128i c1, __m128i c2, __m128i c3) {
+        return zero_mask(_mm_min_epu8(_mm_min_epu8(c0, c1), _mm_min_epu8(c2, c3))) != 0;
+    }
+
+    /* The mask of bytes in the chunk which are zero (or differ). */
+    static auto chunk_mask(const char *ptr) -> unsigned {
+        return zero_mask(as_zero(ptr));
+    }
+    static auto chunk_mask(const char *lhs, const char *rhs) -> unsigned {
+        return zero_mask(as_zero(lhs, rhs));
+    }
+    /* Whether any byte in the block is zero (or differs). */
+    static bool block_any(const char *ptr) {
+        return any_zero(as_zero(ptr), as_zero(ptr + 16), as_zero(ptr + 32), as_zero(ptr + 48));
+    }
+    static bool block_any(const char *lhs, const char *rhs) {
+        return any_zero(as_zero(lhs, rhs),           as_zero(lhs + 16, rhs + 16),
+                        as_zero(lhs + 32, rhs + 32), as_zero(lhs + 48, rhs + 48));
+    }
+    /* Copy the chunk or block if no byte in it is zero. Read before written. */
+    static auto copy_chunk(char *dst, const char *src) -> unsigned {
+        const auto data = load(src);
+        const auto mask = zero_mask(data);
+        if (mask == 0) _mm_storeu_si128(reinterpret_cast <__m128i *> (dst), data);
+        return mask;
+    }
+    static bool copy_block(char *dst, const char *src) {
+        const auto c0 = load(src),      c1 = load(src + 16);
+        const auto c2 = load(src + 32), c3 = load(src + 48);
+        if (any_zero(c0, c1, c2, c3)) return false;
+        auto *out = reinterpret_cast <__m128i *> (dst);
+        _mm_storeu_si128(out + 0, c0), _mm_storeu_si128(out + 1, c1);
+        _mm_storeu_si128(out + 2, c2), _mm_storeu_si128(out + 3, c3);
+        return true;
+    }
+};
+
+struct AVX2 {
+    static constexpr std::size_t kChunk = 32;
+    static constexpr std::size_t kBlock = 4 * kChunk;
+
+    [[gnu::target("avx2")]]
+    static auto load(const char *ptr) -> __m256i {
+        return _mm256_loadu_si256(reinterpret_cast <const __m256i *> (ptr));
+    }
+    [[gnu::target("avx2")]]
+    static auto as_zero(const char *ptr) -> __m256i {
+        return load(ptr);
+    }
+    [[gnu::target("avx2")]]
+    static auto as_zero(const char *lhs, const char *rhs) -> __m256i {
+        const auto data = load(lhs);
+        return _mm256_min_epu8(data, _mm256_cmpeq_epi8(data, load(rhs)));
+    }
+    [[gnu::target("avx2")]]
+    static auto zero_mask(__m256i data) -> unsigned {
+        return _mm256_movemask_epi8(_mm256_cmpeq_epi8(data, _mm256_setzero_si256()));
+    }
+    [[gnu::target("avx2")]]
+    static bool any_zero(__m256i c0, __m256i c1, __m256i c2, __m256i c3) {
+        return zero_mask(_mm256_min_epu8(_mm256_min_epu8(c0, c1), _mm256_min_epu8(c2, c3))) != 0;
+    }
+
+    [[gnu::target("avx2"), gnu::flatten]]
+    static auto chunk_mask(const char *ptr) -> unsigned {
+        return zero_mask(as_zero(ptr));
+    }
+    [[gnu::target("avx2"), gnu::flatten]]
+    static auto chunk_mask(const char *lhs, const char *rhs) -> unsigned {
+        return zero_mask(as_zero(lhs, rhs));
+    }
+    [[gnu::target("avx2"), gnu::flatten]]
+    static bool block_any(const char *ptr) {
+        return any_zero(as_zero(ptr), as_zero(ptr + 32), as_zero(ptr + 64), as_zero(ptr + 96));
+    }
+    [[gnu::target("avx2"), gnu::flatten]]
+    static bool block_any(const char *lhs, const char *rhs) {
+        return any_zero(as_zero(lhs, rhs),           as_zero(lhs + 32, rhs + 32),
+                        as_zero(lhs + 64, rhs + 64), as_zero(lhs + 96, rhs + 96));
+    }
+    [[gnu::target("avx2"), gnu::flatten]]
+    static auto copy_chunk(char *dst, const char *src) -> unsigned {
+        const auto data = load(src);
+        const auto mask = zero_mask(data);
+        if (mask == 0) _mm256_storeu_si256(reinterpret_cast <__m256i *> (dst), data);
+        return mask;
+    }
+    [[gnu::target("avx2"), gnu::flatten]]
+    static bool copy_block(char *dst, const char *src) {
+        const auto c0 = load(src),      c1 = load(src + 32);
+        const auto c2 = load(src + 64), c3 = load(src + 96);
+        if (any_zero(c0, c1, c2, c3)) return false;
+        auto *out = reinterpret_cast <__m256i *> (dst);
+        _mm256_storeu_si256(out + 0, c0), _mm256_storeu_si256(out + 1, c1);
+        _mm256_storeu_si256(out + 2, c2), _mm256_storeu_si256(out + 3, c3);
+        return true;
+    }
+};
+
+#else
+
+// Portable chunks of 8 bytes, if no vector instruction set is known.
+struct Portable {
+    static constexpr std::size_t kChunk = 8;
+    static constexpr std::size_t kBlock = kChunk;
+
+    static auto chunk_mask(const char *ptr) -> unsigned {
+        unsigned mask = 0;
+        for (std::size_t i = 0 ; i < kChunk ; ++i)
+            mask |= unsigned(ptr[i] == 0) << i;
+        return mask;
+    }
+    static auto chunk_mask(const char *lhs, const char *rhs) -> unsigned {
+        unsigned mask = 0;
+        for (std::size_t i = 0 ; i < kChunk ; ++i)
+            mask |= unsigned(lhs[i] == 0 || lhs[i] != rhs[i]) << i;
+        return mask;
+    }
+    static bool block_any(const char *ptr) {
+        return chunk_mask(ptr) != 0;
+    }
+    static bool block_any(const char *lhs, const char *rhs) {
+        return chunk_mask(lhs, rhs) != 0;
+    }
+    static auto copy_chunk(char *dst, const char *src) -> unsigned {
+        char data[kChunk];
+        std::memcpy(data, src, kChunk);
+        const auto mask = chunk_mask(data);
+        if (mask == 0) std::memcpy(dst, data, kChunk);
+        return mask;
+    }
+    static bool copy_block(char *dst, const char *src) {
+        return copy_chunk(dst, src) == 0;
+    }
+};
+
+#endif
+
+/* Length of the string, or size if not terminated within size bytes. */
+template <typename _Isa>
+inline auto length(const char *str, std::size_t size) -> std::size_t {
+    // Most strings end in the first chunk, so it goes before any block.
+    std::size_t i = 0;
+    if (size >= _Isa::kChunk) {
+        if (auto mask = _Isa::chunk_mask(str)) return std::countr_zero(mask);
+        i = _Isa::kChunk;
+    }
+    for (; i + _Isa::kBlock <= size ; i += _Isa::kBlock)
+        if (_Isa::block_any(str + i)) break;
+    for (; i + _Isa::kChunk <= size ; i += _Isa::kChunk)
+        if (auto mask = _Isa::chunk_mask(str + i))
+            return i + std::countr_zero(mask);
+    for (; i < size ; ++i) if (str[i] == 0) return i;
+    return size;
+}
+
+/**
+ * Copy the string with the terminator in one pass, as long as the terminator
+ * is within size bytes. Return the length, or size if not terminated within.
+ * Each chunk is read before written, so dst may be before src.
+ */
+template <typename _Isa>
+inline auto copy(char *dst, const char *src, std::size_t size) -> std::size_t {
+    // Copy the last chunk up to the terminator.
+    const auto finish = [dst, src](std::size_t i, unsigned mask) {
+        const auto length = i + std::countr_zero(mask);
+        std::memmove(dst + i, src + i, length + 1 - i);
+        return length;
+    };
+    std::size_t i = 0;
+    if (size >= _Isa::kChunk) {
+        if (auto mask = _Isa::copy_chunk(dst, src)) return finish(0, mask);
+        i = _Isa::kChunk;
+    }
+    for (; i + _Isa::kBlock <= size ; i += _Isa::kBlock)
+        if (!_Isa::copy_block(dst + i, src + i)) break;
+    for (; i + _Isa::kChunk <= size ; i += _Isa::kChunk)
+        if (auto mask = _Isa::copy_chunk(dst + i, src + i)) return finish(i, mask);
+    for (; i < size ; ++i) {
+        const char c = src[i];
+        dst[i] = c;
+        if (c == 0) return i;
+    }
+    return size;
+}
+
+/* The first position where the strings differ or end, or size if none within. */
+template <typename _Isa>
+inline auto mismatch(const char *lhs, const char *rhs, std::size_t size) -> std::size_t {
+    std::size_t i = 0;
+    if (size >= _Isa::kChunk) {
+        if (auto mask = _Isa::chunk_mask(lhs, rhs)) return std::countr_zero(mask);
+        i = _Isa::kChunk;
+    }
+    for (; i + _Isa::kBlock <= size ; i += _Isa::kBlock)
+        if (_Isa::block_any(lhs + i, rhs + i)) break;
+    for (; i + _Isa::kChunk <= size ; i += _Isa::kChunk)
+        if (auto mask = _Isa::chunk_mask(lhs + i, rhs + i))
+            return i + std::countr_zero(mask);
+    for (; i < size ; ++i) if (lhs[i] != rhs[i] || lhs[i] == 0) return i;
+    return size;
+}
+
+#if defined(__x86_64__)
+
+// AVX2 is checked once at startup, as the build only assumes SSE2.
+inline const bool kHasAVX2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+
+[[gnu::target("avx2"), gnu::flatten]]
+inline auto length_avx2(const char *str, std::size_t size) -> std::size_t {
+    return length <AVX2> (str, size);
+}
+
+[[gnu::target("avx2"), gnu::flatten]]
+inline auto copy_avx2(char *dst, const char *src, std::size_t size) -> std::size_t {
+    return copy <AVX2> (dst, src, size);
+}
+
+[[gnu::target("avx2"), gnu::flatten]]
+inline auto mismatch_avx2(const char *lhs, const char *rhs, std::size_t size) -> std::size_t {
+    return mismatch <AVX2> (lhs, rhs, size);
+}
+
+#endif
+
+} // namespace kernel
+
+[[maybe_unused]]
+static auto bounded_length(const char *str, std::size_t size) -> std::size_t {
+#if defined(__x86_64__)
+    if (kernel::kHasAVX2) return kernel::length_avx2(str, size);
+    return kernel::length <kernel::SSE2> (str, size);
+#else
+    return kernel::length <kernel::Portable> (str, size);
+#endif
+}
+
+[[maybe_unused]]
+static auto bounded_copy(char *dst, const char *src, std::size_t size) -> std::size_t {
+#if defined(__x86_64__)
+    if (kernel::kHasAVX2) return kernel::copy_avx2(dst, src, size);
+    return kernel::copy <kernel::SSE2> (dst, src, size);
+#else
+    return kernel::copy <kernel::Portable> (dst, src, size);
+#endif
+}
+
+[[maybe_unused]]
+static auto bounded_mismatch(const char *lhs, const char *rhs, std::size_t size) -> std::size_t {
+#if defined(__x86_64__)
+    if (kernel::kHasAVX2) return kernel::mismatch_avx2(lhs, rhs, size);
+    return kernel::mismatch <kernel::SSE2> (lhs, rhs, size);
+#else
+    return kernel::mismatch <kernel::Portable> (lhs, rhs, size);
+#endif
+}
+
+} // namespace dark::libc::__details
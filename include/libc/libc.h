@@ -50,4 +50,7 @@ static constexpr auto kLibcEnd = kTextStart + std::size(names) * sizeof(command_
 
 void libc_init(RegisterFile &, Memory &, Device &);
 
+// Print heap usage, if any.
+void print_details(bool);
+
 } // namespace dark::libc
@@ -2,11 +2,25 @@
 #include <libc/libc.h>
 #include <utility.h>
 #include <interpreter/memory.h>
+#include <array>
+#include <bit>
 #include <span>
 #include <cstring>
 
 namespace dark::libc {
 
+/**
+ * A segregated free-list allocator on top of sbrk.
+ *
+ * Each chunk starts with a header, which also serves as the boundary tag
+ * of the previous chunk, so that neighbours can be coalesced in O(1).
+ * The last 8 bytes before brk hold a sentinel header of size 0.
+ *
+ * Free chunks keep their list links right after the header, and are
+ * binned by size: one exact class per 16 bytes for small chunks,
+ * and one class per power of 2 for the rest. Free chunks are never
+ * adjacent, and a free chunk at the top is given back to the heap.
+ */
 struct MemoryManager {
     struct Header {
     public:
@@ -14,30 +28,59 @@ struct MemoryManager {
             return this->prev;
         }
         auto get_this_size() const {
-            return this->self;
+            return this->self & ~kFreeBit;
+        }
+        bool is_free() const {
+            return (this->self & kFreeBit) != 0;
         }
         void set_prev_size(std::uint32_t size) {
             this->prev = size;
         }
-        void set_this_size(std::uint32_t size) {
-            this->self = size;
+        void set_this_size(std::uint32_t size, bool free = false) {
+            this->self = size | (free ? kFreeBit : 0);
         }
     private:
+        // Sizes are aligned, so the lowest bit is free to use.
+        static constexpr std::uint32_t kFreeBit = 1;
         std::uint32_t prev;
         std::uint32_t self;
     };
 
+    // Links of a free chunk, in guest addresses of the headers.
+    struct Links {
+        target_size_t next;
+        target_size_t prev;
+    };
+
     static constexpr target_size_t kMinAlignment = alignof(std::max_align_t);
     static constexpr target_size_t kHeaderSize   = sizeof(Header);
     static constexpr target_size_t kMinAllocSize = sizeof(void *) * 2;
 
+    static_assert(kMinAllocSize >= sizeof(Links));
+
+    static constexpr target_size_t kSmallLimit   = 512;
+    static constexpr std::size_t   kSmallClasses = kSmallLimit / kMinAlignment;
+    static constexpr std::size_t   kNumClasses   =
+        kSmallClasses + std::bit_width(std::uint64_t(1) << 32) - std::bit_width(kSmallLimit);
+
+    static_assert(kNumClasses <= 64, "Class bitmap must fit in 64 bits");
+
     target_size_t start;    // start of the heap
     target_size_t brk;      // current break, aligned to kMinAlignment
 
-    consteval MemoryManager() : start(), brk() {}
+    std::array <target_size_t, kNumClasses> bins;   // Head of each class, 0 if empty.
+    std::uint64_t binmap;                           // Non-empty classes.
+
+    // Statistics, in bytes of chunks.
+    target_size_t live;
+    target_size_t free_bytes;
+    target_size_t peak;
+
+    consteval MemoryManager() :
+        start(), brk(), bins(), binmap(), live(), free_bytes(), peak() {}
 
 private:
-    static auto align(target_size_t ptr) -> target_size_t {
+    static constexpr auto align(target_size_t ptr) -> target_size_t {
         constexpr auto kMask = kMinAlignment - 1;
         return (ptr + kMask) & ~kMask;
     }
@@ -46,23 +89,157 @@ private:
         return *std::bit_cast <Header *> (ptr - kHeaderSize);
     }
 
+    static auto get_header(Memory &mem, target_size_t header) -> Header & {
+        return *std::bit_cast <Header *> (mem.libc_access(header).data());
+    }
+
+    static auto get_links(Memory &mem, target_size_t header) -> Links & {
+        return *std::bit_cast <Links *> (mem.libc_access(header + kHeaderSize).data());
+    }
+
     [[noreturn]]
     static void unknown_malloc_pointer(target_size_t, __details::_Index);
 
-    static auto get_required_size(target_size_t size) -> target_size_t {
+    static constexpr auto get_required_size(target_size_t size) -> target_size_t {
+        // Sizes which can never fit are capped, so that they do not wrap
+        // around, and sbrk reports them as out of memory.
+        constexpr auto kMaxRequired = target_size_t(INT32_MAX) & ~(kMinAlignment - 1);
+        if (size > kMaxRequired - kHeaderSize) return kMaxRequired;
         return align(std::max(size + kHeaderSize, kMinAllocSize + kHeaderSize));
     }
 
-    [[nodiscard]]
-    auto allocate_required(Memory &mem, target_size_t required) {
-        const auto ret_pair = mem.sbrk(required);
-        const auto [real_ptr, old_brk] = ret_pair;
-        runtime_assert(this->brk == old_brk);
+    static auto get_class(target_size_t size) -> std::size_t {
+        if (size < kSmallLimit) return size / kMinAlignment;
+        return kSmallClasses + std::bit_width(size) - std::bit_width(kSmallLimit);
+    }
 
+    auto get_sentinel() const -> target_size_t {
+        return this->brk - kHeaderSize;
+    }
+
+    // Set the size of a chunk, and the boundary tag in the next header.
+    static void set_chunk(Memory &mem, target_size_t header, target_size_t size, bool free) {
+        get_header(mem, header).set_this_size(size, free);
+        get_header(mem, header + size).set_prev_size(size);
+    }
+
+    void link(Memory &mem, target_size_t header, target_size_t size) {
+        const auto which = get_class(size);
+        const auto head  = this->bins[which];
+        get_links(mem, header) = { .next = head, .prev = 0 };
+        if (head != 0) get_links(mem, head).prev = header;
+        this->bins[which]   = header;
+        this->binmap       |= std::uint64_t(1) << which;
+        this->free_bytes   += size;
+    }
+
+    void unlink(Memory &mem, target_size_t header, target_size_t size) {
+        const auto which = get_class(size);
+        const auto links = get_links(mem, header);
+        if (links.prev != 0) get_links(mem, links.prev).next = links.next;
+        else this->bins[which] = links.next;
+        if (links.next != 0) get_links(mem, links.next).prev = links.prev;
+        if (this->bins[which] == 0) this->binmap &= ~(std::uint64_t(1) << which);
+        this->free_bytes   -= size;
+    }
+
+    /* Take a free chunk of at least required bytes, or return 0 if none. */
+    auto take(Memory &mem, target_size_t required) -> target_size_t {
+        const auto which = get_class(required);
+        if (which >= kSmallClasses) {
+            // Sizes vary within a large class, so we need a first-fit scan.
+            for (auto header = this->bins[which]; header != 0;
+                 header = get_links(mem, header).next) {
+                if (const auto size = get_header(mem, header).get_this_size(); size >= required)
+                    return this->unlink(mem, header, size), header;
+            }
+        } else if (const auto header = this->bins[which]; header != 0) {
+            return this->unlink(mem, header, required), header;
+        }
+
+        // Any chunk in a larger class is large enough.
+        const auto mask = ~((std::uint64_t(2) << which) - 1);
+        if (const auto larger = this->binmap & mask; larger != 0) {
+            const auto header = this->bins[std::countr_zero(larger)];
+            return this->unlink(mem, header, get_header(mem, header).get_this_size()), header;
+        }
+
+        return 0;
+    }
+
+    /**
+     * Give back a chunk, which is not in use and not in any list.
+     * It is merged with free neighbours, and with the top of heap.
+     */
+    void release(Memory &mem, target_size_t header, target_size_t size) {
+        // An absorbed header gets size 0, so that freeing it again is caught.
+        if (const auto next = header + size; next != this->get_sentinel()) {
+            if (auto &tag = get_header(mem, next); tag.is_free()) {
+                const auto next_size = tag.get_this_size();
+                this->unlink(mem, next, next_size);
+                tag.set_this_size(0);
+                size += next_size;
+            }
+        }
+
+        if (const auto prev_size = get_header(mem, header).get_prev_size(); prev_size != 0) {
+            if (const auto prev = header - prev_size; get_header(mem, prev).is_free()) {
+                this->unlink(mem, prev, prev_size);
+                get_header(mem, header).set_this_size(0);
+                header  = prev;
+                size   += prev_size;
+            }
+        }
+
+        if (header + size == this->get_sentinel()) {
+            // The chunk becomes the new sentinel.
+            static_cast <void> (mem.sbrk(-static_cast <target_ssize_t> (size)));
+            this->brk -= size;
+            get_header(mem, header).set_this_size(0);
+        } else {
+            set_chunk(mem, header, size, true);
+            this->link(mem, header, size);
+        }
+    }
+
+    /* Cut a chunk in use down to required bytes, and give back the rest. */
+    void split(Memory &mem, target_size_t header, target_size_t size, target_size_t required) {
+        if (size - required < get_required_size(0)) return;
+        set_chunk(mem, header, required, false);
+        this->live -= size - required;
+        this->release(mem, header + required, size - required);
+    }
+
+    /* Extend the heap, where the old sentinel becomes the header. */
+    auto extend(Memory &mem, target_size_t required) -> target_size_t {
+        const auto header = this->get_sentinel();
+        static_cast <void> (mem.sbrk(required));
         this->brk += required;
-        this->get_header(real_ptr).set_this_size(required);
+        get_header(mem, this->get_sentinel()).set_this_size(0);
+        return header;
+    }
 
-        return ret_pair;
+    void update_peak() {
+        this->peak = std::max(this->peak, this->brk - this->start);
+    }
+
+    [[nodiscard]]
+    auto allocate_required(Memory &mem, target_size_t required) {
+        auto header = this->take(mem, required);
+        if (header != 0) {
+            const auto size = get_header(mem, header).get_this_size();
+            set_chunk(mem, header, size, false);
+            this->live += size;
+            this->split(mem, header, size, required);
+        } else {
+            header = this->extend(mem, required);
+            set_chunk(mem, header, required, false);
+            this->live += required;
+            this->update_peak();
+        }
+
+        const auto retval = header + kHeaderSize;
+        return std::make_pair(mem.libc_access(retval).data(), retval);
     }
 
 public:
@@ -79,6 +256,10 @@ public:
         runtime_assert(
             this->start == old_brk &&
             std::bit_cast <std::size_t> (real_ptr) % kMinAlignment == 0);
+
+        // The first sentinel, with no chunk before it.
+        get_header(mem, this->get_sentinel()).set_prev_size(0);
+        get_header(mem, this->get_sentinel()).set_this_size(0);
     }
 
     [[nodiscard]]
@@ -86,27 +267,57 @@ public:
         return this->allocate_required(mem, this->get_required_size(new_size));
     }
 
-    void free(Memory &, target_size_t) {
-        // Do nothing for now
+    void free(Memory &mem, target_size_t ptr) {
+        if (ptr == 0) return;
+        const auto area = parse_malloc_ptr(mem, ptr);
+        if (area.size() == 0)
+            unknown_malloc_pointer(ptr, __details::_Index::free);
+        this->live -= area.size();
+        this->release(mem, ptr - kHeaderSize, area.size());
     }
 
     [[nodiscard]]
     auto reallocate(Memory &mem, target_size_t old_ptr, target_size_t new_size)
     -> target_size_t {
         const auto area = parse_malloc_ptr(mem, old_ptr);
-        auto old_data = area.data();
-        auto old_size = area.size();
-        auto required = this->get_required_size(new_size);
+        const auto header   = old_ptr - kHeaderSize;
+        const auto old_size = static_cast <target_size_t> (area.size());
+        const auto required = this->get_required_size(new_size);
         if (old_size == 0) {
             unknown_malloc_pointer(old_ptr, __details::_Index::realloc);
         } else if (old_size >= required) {
+            this->split(mem, header, old_size, required);
+            return old_ptr;
+        }
+
+        const auto next = header + old_size;
+        if (next == this->get_sentinel()) {
+            // At the top of heap, so just extend it.
+            static_cast <void> (this->extend(mem, required - old_size));
+            set_chunk(mem, header, required, false);
+            this->live += required - old_size;
+            this->update_peak();
             return old_ptr;
-        } else {
-            auto [new_data, new_ptr] = this->allocate_required(mem, required);
-            std::memcpy(new_data, old_data, old_size);
-            this->free(mem, old_ptr);
-            return new_ptr;
         }
+
+        if (auto &tag = get_header(mem, next); tag.is_free()) {
+            // Absorb the free chunk after it.
+            const auto next_size = tag.get_this_size();
+            if (old_size + next_size >= required) {
+                this->unlink(mem, next, next_size);
+                set_chunk(mem, header, old_size + next_size, false);
+                this->live += next_size;
+                this->split(mem, header, old_size + next_size, required);
+                return old_ptr;
+            }
+        }
+
+        auto [new_data, new_ptr] = this->allocate_required(mem, required);
+        // The heap may have moved, so we look up the old data again.
+        // The last 8 bytes of a chunk belong to the next header.
+        std::memcpy(new_data, mem.libc_access(old_ptr).data(), old_size - kHeaderSize);
+        this->free(mem, old_ptr);
+        return new_ptr;
     }
 
     auto parse_malloc_ptr(Memory &mem, const target_size_t malloc_ptr)
@@ -127,6 +338,9 @@ public:
         auto &header    = this->get_header(data_ptr);
         auto this_size  = header.get_this_size();
 
+        if (header.is_free() || this_size == 0)
+            return {};
+
         if (this_size % kMinAlignment != 0)
             return {};
 
@@ -136,6 +350,15 @@ public:
         return { data_ptr, this_size };
     }
 
+    void print_details() const {
+        if (this->peak == 0) return;
+        const auto total = this->live + this->free_bytes;
+        console::profile << std::format(
+            "Heap usage: peak = {}, live = {}, fragmentation = {:.2f}%\n",
+            this->peak, this->live, total == 0 ? 0.0 : this->free_bytes * 100.0 / total
+        );
+    }
+
 };
 
 } // namespace dark::libc
@@ -1,9 +1,11 @@
 #pragma once
 #include <libc/libc.h>
 #include <interpreter/memory.h>
+#include <interpreter/device.h>
 #include <interpreter/register.h>
 #include <interpreter/exception.h>
 #include <interpreter/hint.h>
+#include <libc/kernel.h>
 #include <cstring>
 #include <fmtlib.h>
 
@@ -71,7 +73,7 @@ static _Int &aligned_access(Memory &mem, target_size_t addr) {
 template <_Index index>
 static auto checked_get_string(Memory &mem, target_size_t str, std::size_t extra = 0) {
     auto area = mem.libc_access(str);
-    auto length = ::strnlen(area.data(), area.size());
+    auto length = bounded_length(area.data(), area.size());
 
     if (length + extra >= area.size())
         handle_outofbound<index>(str + area.size(), sizeof(char));
@@ -106,7 +108,7 @@ static auto checked_get_areas(Memory &mem, target_size_t dst, target_size_t src,
 }
 
 [[maybe_unused]]
-static auto return_to_user(RegisterFile &rf, Memory &, target_size_t retval) -> Hint {
+static auto return_to_user(RegisterFile &rf, Memory &, Device &dev, target_size_t retval) -> Hint {
     using enum Register;
 
     // Necessary setup
@@ -121,8 +123,14 @@ static auto return_to_user(RegisterFile &rf, Memory &, target_size_t retval) ->
         // ra is the return address, normally it is untouched
     };
 
-    // Enjoy the magic number ~
-    for (auto reg : caller_saved_poison) rf[reg] = 0xDEADBEEF;
+    // Enjoy the magic number ~ (but not always, see --poison)
+    if (dev.poison.period != 0 && ++dev.poison.count == dev.poison.period) {
+        dev.poison.count = 0;
+        for (auto reg : caller_saved_poison) rf[reg] = 0xDEADBEEF;
+    }
+
+    // The call has pushed the return site, so pop it as a return does.
+    if (auto *next = dev.ras.pop(rf.get_pc())) return Hint { next, true };
 
     return Hint {}; // No hint
 }
@@ -6,20 +6,99 @@
 #include <interpreter/forward.h>
 #include <interpreter/interval.h>
 #include <vector>
+#include <cstring>
 #include <algorithm>
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 namespace dark {
 
+/**
+ * Guest addresses from low to the top of 32-bit space, reserved
+ * in host memory with no access, and committed in place on demand.
+ * The mapping never moves, so host pointers into it stay valid.
+ * The base is null if not enabled or not supported.
+ */
+struct ReservedSpace {
+  private:
+    static constexpr std::size_t kSpaceSize = std::size_t(1) << 32;
+    static constexpr std::size_t kPageSize  = std::size_t(1) << 12;
+
+    std::byte *const    base;   // Host address of guest address 0.
+    std::size_t const   low;
+
+    static auto reserve(bool enable, std::size_t low) -> std::byte * {
+        if (!enable) return nullptr;
+#if defined(__linux__)
+        auto *ptr = ::mmap(nullptr, kSpaceSize - low, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr != MAP_FAILED) return static_cast <std::byte *> (ptr) - low;
+#endif
+        return nullptr;
+    }
+
+  public:
+    explicit ReservedSpace(bool enable, target_size_t low = 0) :
+        base(reserve(enable, low)), low(low) {}
+    ReservedSpace(const ReservedSpace &) = delete;
+    auto get_base() const -> std::byte * {
+        return this->base;
+    }
+    /* End of the reserved space, which is the top of 32-bit space. */
+    static constexpr auto get_finish() -> std::size_t {
+        return kSpaceSize;
+    }
+    /* Commit [lo, hi) in whole pages. Fresh pages are zero-filled. */
+    void commit(std::size_t lo, std::size_t hi) {
+        if (lo >= hi) return;
+#if defined(__linux__)
+        const auto page_lo = lo & ~(kPageSize - 1);
+        const auto page_hi = std::min((hi + kPageSize - 1) & ~(kPageSize - 1), kSpaceSize);
+        if (::mprotect(this->base + page_lo, page_hi - page_lo, PROT_READ | PROT_WRITE) == 0)
+            return;
+#endif
+        panic("Failed to commit guest memory [0x{:x}, 0x{:x})", lo, hi);
+    }
+    ~ReservedSpace() {
+#if defined(__linux__)
+        if (this->base != nullptr) ::munmap(this->base + this->low, kSpaceSize - this->low);
+#endif
+    }
+};
+
+/**
+ * The whole 32-bit guest address space, reserved with no access.
+ * Each area commits its own part, so that any guest address
+ * is mapped to base + addr, whichever area it belongs to.
+ */
+struct FlatSpace : ReservedSpace {
+    explicit FlatSpace(const Config &config) : ReservedSpace(config.has_option("flat")) {
+        if (config.has_option("flat") && this->get_base() == nullptr)
+            warning("Failed to reserve flat guest memory (Linux only), fall back to separate areas.");
+    }
+};
+
 struct StaticArea {
   private:
     const Interval text;
     const Interval data;
     std::byte *const storage;
+    bool const owned;   // Whether storage is allocated by us, not in a flat space.
+    static auto allocate(ReservedSpace &flat, Interval range) -> std::byte * {
+        if (auto *base = flat.get_base()) {
+            flat.commit(range.start, range.finish);
+            return base;
+        }
+        return new std::byte[range.finish - range.start] {} - range.start;
+    }
   public:
-    explicit StaticArea(const MemoryLayout &layout) :
+    explicit StaticArea(const MemoryLayout &layout, ReservedSpace &flat) :
         text({layout.text.begin(), layout.text.end()}),
         data({layout.data.begin(), layout.bss.end()}),
-        storage(new std::byte[data.finish - text.start] {} - text.start)
+        storage(allocate(flat, { text.start, data.finish })),
+        owned(flat.get_base() == nullptr)
     {
         runtime_assert(text.start == libc::kLibcEnd);
         constexpr auto __copy = [](StaticArea *area, const auto &section) {
@@ -48,14 +127,25 @@ struct StaticArea {
     auto get_data_range() const {
         return this->data;
     }
-    ~StaticArea() { delete (this->storage + this->text.start); }
+    ~StaticArea() { if (this->owned) delete[] (this->storage + this->text.start); }
 };
 
 struct HeapArea {
   private:
+    // The heap is committed in place in a reserved space if possible,
+    // so that it never copies on growth, and pointers stay valid.
+    // Otherwise, it falls back to a vector.
     std::vector <std::byte> storage;
-    target_size_t const heap_start;
-    target_size_t       heap_finish;
+    ReservedSpace           reserved;   // Our own, if not in a flat space.
+    ReservedSpace *const    space;      // Where the heap lives, or null.
+    std::byte *             base;       // Host address of guest address 0.
+    target_size_t const     heap_start;
+    target_size_t           heap_finish;
+    std::size_t             committed;  // End of committed memory.
+
+    // Commit in chunks, so that small sbrk calls rarely trap into the kernel.
+    static constexpr std::size_t kCommitChunk = std::size_t(1) << 16;
+
     // Our implementation require that the end of static area
     // should not overlap with the start of heap area
     // So, we need to choose the next page even if already aligned
@@ -63,31 +153,64 @@ struct HeapArea {
         constexpr auto kPageSize = 1 << 12;
         return (addr & ~(kPageSize - 1)) + kPageSize;
     }
+    static auto select(ReservedSpace &flat, ReservedSpace &reserved) -> ReservedSpace * {
+        if (flat.get_base() != nullptr) return &flat;
+        if (reserved.get_base() != nullptr) return &reserved;
+        return nullptr;
+    }
   public:
-    explicit HeapArea(const MemoryLayout &layout) :
+    explicit HeapArea(const MemoryLayout &layout, ReservedSpace &flat) :
+        reserved(flat.get_base() == nullptr, next_page(layout.bss.end())),
+        space(select(flat, reserved)),
+        base(space != nullptr ? space->get_base() : nullptr),
         heap_start(next_page(layout.bss.end())),
-        heap_finish(heap_start) {}
+        heap_finish(heap_start),
+        committed(heap_start) {
+        // The gap after bss is committed, so that the data and
+        // heap can be accessed as one range in the flat space.
+        if (flat.get_base() != nullptr) flat.commit(layout.bss.end(), heap_start);
+    }
     bool in_heap(target_size_t lo, target_size_t hi) const {
         return this->heap_start <= lo && hi <= this->heap_finish;
     }
     auto *get_heap(target_size_t addr) {
-        return this->storage.data() - this->heap_start + addr;
+        return this->base + addr;
     }
     auto get_range() const -> Interval {
         return { this->heap_start, this->heap_finish };
     }
     auto grow(target_ssize_t size) {
+        const auto retval = this->heap_finish;
+
+        // Caller (Memory::sbrk) should have checked this, so no wrap around.
+        const auto finish = std::int64_t(retval) + size;
+        runtime_assert(this->heap_start <= finish
+            && std::size_t(finish) <= ReservedSpace::get_finish());
+        this->heap_finish = static_cast <target_size_t> (finish);
+
+        if (this->space != nullptr) {
+            // Grow in place. Released memory is cleared,
+            // as if it were never allocated.
+            if (this->heap_finish > this->committed) {
+                const auto target = std::min((std::size_t(this->heap_finish) + kCommitChunk - 1)
+                    & ~(kCommitChunk - 1), ReservedSpace::get_finish());
+                this->space->commit(this->committed, target);
+                this->committed = target;
+            } else if (size < 0) {
+                std::memset(this->get_heap(this->heap_finish), 0, -size);
+            }
+            return std::make_pair(std::bit_cast <char *> (this->get_heap(retval)), retval);
+        }
+
         /// TODO: remove this useless check
-        const auto old_size = this->heap_finish - this->heap_start;
+        const auto old_size = retval - this->heap_start;
         runtime_assert(old_size == this->storage.size());
-
-        const auto retval = this->heap_finish;
-        this->heap_finish += size;
         const auto new_size = old_size + size;
 
         // To avoid too many reallocations, we reserve the next power of 2
         if (size > 0) this->storage.reserve(std::bit_ceil(new_size));
         this->storage.resize(new_size);
+        this->base = this->storage.data() - this->heap_start;
 
         return std::make_pair(std::bit_cast <char *> (this->get_heap(retval)), retval);
     }
@@ -97,11 +220,16 @@ struct StackArea {
   private:
     const Interval stack;
     std::byte * const storage;
+    bool const owned;   // Whether storage is allocated by us, not in a flat space.
   public:
-    explicit StackArea(const Config &config) :
+    explicit StackArea(const Config &config, ReservedSpace &flat) :
         stack({config.get_stack_low(), config.get_stack_top()}),
-        storage(new std::byte[stack.finish - stack.start] {} - stack.start)
-    {}
+        storage(flat.get_base() != nullptr ? flat.get_base()
+            : new std::byte[stack.finish - stack.start] {} - stack.start),
+        owned(flat.get_base() == nullptr)
+    {
+        if (!this->owned) flat.commit(stack.start, stack.finish);
+    }
 
     bool in_stack(target_size_t lo, target_size_t hi) const {
         return this->stack.contains(lo, hi);
@@ -112,7 +240,7 @@ struct StackArea {
     auto get_range() const {
         return this->stack;
     }
-    ~StackArea() { delete (this->storage + this->stack.start); }
+    ~StackArea() { if (this->owned) delete[] (this->storage + this->stack.start); }
 };
 
 } // namespace dark
@@ -0,0 +1,2 @@
+// Should only be included in interpretor/device.cpp
+#include <simulation/implement/cache_impl.h>
@@ -29,10 +29,19 @@ inline auto Executable::MetaData::parse(RegisterFile &rf) const -> PackData {
 
 namespace dark::interpreter {
 
+/**
+ * Handlers below come in several instances, picked by the decoder:
+ * - _Discard: rd is zero, so the result is dropped (e.g. nop, j, ret).
+ *   No handler ever writes to zero, so it needs no reset after each command.
+ * - _Zero: rs2 is zero, so it is not read at all (e.g. beqz, bnez).
+ * - _Count: false if counters of block bodies are updated in batch,
+ *   once per block execution (see --batch). Terminators always count.
+ */
+
 namespace __details {
 
-template <general::ArithOp op>
-static void arith_impl(target_size_t &rd, target_size_t rs1, target_size_t rs2, Device &dev) {
+template <general::ArithOp op, bool _Count = true>
+static auto arith_impl(target_size_t rs1, target_size_t rs2, Device &dev) -> target_size_t {
     static_assert(sizeof(target_size_t) == 4);
  
     using i32 = std::int32_t;
@@ -42,6 +51,7 @@ static void arith_impl(target_size_t &rd, target_size_t rs1, target_size_t rs2,
     constexpr auto u64 = [](u32 x) { return static_cast<std::uint64_t>(x); };
 
     using enum general::ArithOp;
+    #define add_counter(name) if constexpr (_Count) dev.counter.name++
     #define check_zero \
         rs2 == 0 ? throw FailToInterpret { \
             .error = Error::DivideByZero, \
@@ -49,76 +59,110 @@ static void arith_impl(target_size_t &rd, target_size_t rs1, target_size_t rs2,
         }
 
     switch (op) {
-        case ADD:   rd = rs1 + rs2; dev.counter.add++; return;
-        case SUB:   rd = rs1 - rs2; dev.counter.sub++; return;
-        case AND:   rd = rs1 & rs2; dev.counter.and_++; return;
-        case OR:    rd = rs1 | rs2; dev.counter.or_++; return;
-        case XOR:   rd = rs1 ^ rs2; dev.counter.xor_++; return;
-        case SLL:   rd = rs1 << rs2; dev.counter.sll++; return;
-        case SRL:   rd = u32(rs1) >> rs2; dev.counter.srl++; return;
-        case SRA:   rd = i32(rs1) >> rs2; dev.counter.sra++; return;
-        case SLT:   rd = i32(rs1) < i32(rs2); dev.counter.slt++; return;
-        case SLTU:  rd = u32(rs1) < u32(rs2); dev.counter.sltu++; return;
-        case MUL:   rd = rs1 * rs2; dev.counter.mul++; return;
-        case MULH:  rd = (i64(rs1) * i64(rs2)) >> 32; dev.counter.mulh++; return;
-        case MULHSU:rd = (i64(rs1) * u64(rs2)) >> 32; dev.counter.mulhsu++; return;
-        case MULHU: rd = (u64(rs1) * u64(rs2)) >> 32; dev.counter.mulhu++; return;
-        case DIV:   rd = check_zero : i32(rs1) / i32(rs2); dev.counter.div++; return;
-        case DIVU:  rd = check_zero : u32(rs1) / u32(rs2); dev.counter.divu++; return;
-        case REM:   rd = check_zero : i32(rs1) % i32(rs2); dev.counter.rem++; return;
-        case REMU:  rd = check_zero : u32(rs1) % u32(rs2); dev.counter.remu++; return;
+        case ADD:   add_counter(add); return rs1 + rs2;
+        case SUB:   add_counter(sub); return rs1 - rs2;
+        case AND:   add_counter(and_); return rs1 & rs2;
+        case OR:    add_counter(or_); return rs1 | rs2;
+        case XOR:   add_counter(xor_); return rs1 ^ rs2;
+        case SLL:   add_counter(sll); return rs1 << rs2;
+        case SRL:   add_counter(srl); return u32(rs1) >> rs2;
+        case SRA:   add_counter(sra); return i32(rs1) >> rs2;
+        case SLT:   add_counter(slt); return i32(rs1) < i32(rs2);
+        case SLTU:  add_counter(sltu); return u32(rs1) < u32(rs2);
+        case MUL:   add_counter(mul); return rs1 * rs2;
+        case MULH:  add_counter(mulh); return (i64(rs1) * i64(rs2)) >> 32;
+        case MULHSU:add_counter(mulhsu); return (i64(rs1) * u64(rs2)) >> 32;
+        case MULHU: add_counter(mulhu); return (u64(rs1) * u64(rs2)) >> 32;
+        case DIV:   add_counter(div); return check_zero : i32(rs1) / i32(rs2);
+        case DIVU:  add_counter(divu); return check_zero : u32(rs1) / u32(rs2);
+        case REM:   add_counter(rem); return check_zero : i32(rs1) % i32(rs2);
+        case REMU:  add_counter(remu); return check_zero : u32(rs1) % u32(rs2);
         default:    unreachable();
     }
     #undef check_zero
+    #undef add_counter
 }
 
 } // namespace __details
 
 namespace ArithReg {
-    template <general::ArithOp op>
-    static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
+    template <general::ArithOp op, bool _Discard = false, bool _Count = true>
+    static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-        __details::arith_impl <op> (rd, rs1, rs2, dev);
-        return exe.next();
+        auto value = __details::arith_impl <op, _Count> (rs1, rs2, dev);
+        if constexpr (!_Discard) rd = value;
+        return exe.next(rf, mem, dev);
     }
 } // namespace ArithReg
 
 namespace ArithImm {
-    template <general::ArithOp op>
-    static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
+    template <general::ArithOp op, bool _Discard = false, bool _Count = true>
+    static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-        __details::arith_impl <op> (rd, rs1, imm, dev);
-        return exe.next();
+        auto value = __details::arith_impl <op, _Count> (rs1, imm, dev);
+        if constexpr (!_Discard) rd = value;
+        return exe.next(rf, mem, dev);
     }
 } // namespace ArithImm
 
+namespace Li { // addi rd, zero, imm
+    template <bool _Count = true>
+    static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
+        auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
+        rd = imm;
+        if constexpr (_Count) dev.counter.add++;
+        return exe.next(rf, mem, dev);
+    }
+} // namespace Li
+
+namespace Mv { // addi rd, rs1, 0
+    template <bool _Count = true>
+    static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
+        auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
+        rd = rs1;
+        if constexpr (_Count) dev.counter.add++;
+        return exe.next(rf, mem, dev);
+    }
+} // namespace Mv
+
 namespace LoadStore {
-    template <general::MemoryOp op>
+    template <general::MemoryOp op, bool _Discard = false, bool _Count = true>
     static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
         auto addr = rs1 + imm;
 
+        // A load into zero is still performed, since it may fail.
+        target_size_t value {};
+
         using enum general::MemoryOp;
+        #define add_counter(name) if constexpr (_Count) dev.counter.name++
         switch (op) {
-            case LB:    rd = mem.load_i8(addr); dev.counter.lb++; break;
-            case LH:    rd = mem.load_i16(addr); dev.counter.lh++; break;
-            case LW:    rd = mem.load_i32(addr); dev.counter.lw++; break;
-            case LBU:   rd = mem.load_u8(addr); dev.counter.lbu++; break;
-            case LHU:   rd = mem.load_u16(addr); dev.counter.lhu++; break;
-            case SB:    mem.store_u8(addr, rs2); dev.counter.sb++; break;
-            case SH:    mem.store_u16(addr, rs2); dev.counter.sh++; break;
-            case SW:    mem.store_u32(addr, rs2); dev.counter.sw++; break;
+            case LB:    value = mem.load <std::int8_t> (addr); add_counter(lb); break;
+            case LH:    value = mem.load <std::int16_t> (addr); add_counter(lh); break;
+            case LW:    value = mem.load <std::int32_t> (addr); add_counter(lw); break;
+            case LBU:   value = mem.load <std::uint8_t> (addr); add_counter(lbu); break;
+            case LHU:   value = mem.load <std::uint16_t> (addr); add_counter(lhu); break;
+            case SB:    mem.store <std::uint8_t> (addr, rs2); add_counter(sb); break;
+            case SH:    mem.store <std::uint16_t> (addr, rs2); add_counter(sh); break;
+            case SW:    mem.store <std::uint32_t> (addr, rs2); add_counter(sw); break;
             default:    unreachable();
         }
+        #undef add_counter
+
+        // Every access goes to the cache, even if counted in batch.
+        if (dev.cache.data) dev.access(addr);
 
-        return exe.next();
+        constexpr bool is_load = op != SB && op != SH && op != SW;
+        if constexpr (is_load && !_Discard) rd = value;
+
+        return exe.next(rf, mem, dev);
     }
 } // namespace LoadStore
 
 namespace Branch {
-    template <general::BranchOp op>
+    template <general::BranchOp op, bool _Zero = false, bool _Chain = false>
     static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
-        auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
+        auto &&[rd, rs1, rs2_, imm] = exe.get_meta().parse(rf);
         static_assert(sizeof(target_size_t) == 4);
 
         using i32 = std::int32_t;
@@ -126,6 +170,8 @@ namespace Branch {
 
         using enum general::BranchOp;
 
+        const auto rs2 = _Zero ? target_size_t {} : rs2_;
+
         bool result {};
         switch (op) {
             case BEQ:   result = (rs1 == rs2); dev.counter.beq++; break;
@@ -140,59 +186,72 @@ namespace Branch {
         dev.predict(rf.get_pc(), result);
         if (result) {
             rf.set_pc(rf.get_pc() + imm);
-            return exe.next(imm);
+            return _Chain ? exe.chain(imm) : Hint {};
         } else {
-            return exe.next();
+            return _Chain ? exe.chain() : exe.next();
         }
     }
 } // namespace Branch
 
 namespace Jump {
-    [[maybe_unused]]
+    /**
+     * A call (_Call) records its return site in the return stack.
+     * The site is only cached (_Cached) if it is in the same page.
+     */
+    template <bool _Discard = false, bool _Chain = false, bool _Call = false, bool _Cached = true>
     static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
 
-        rd = rf.get_pc() + 4;
+        if constexpr (!_Discard) rd = rf.get_pc() + 4;
+        if constexpr (_Call) dev.ras.push(rf.get_pc() + 4, _Cached ? &exe + 1 : nullptr);
         rf.set_pc(rf.get_pc() + imm);
         dev.counter.jal++;
 
-        return exe.next(imm);
+        return _Chain ? exe.chain(imm) : Hint {};
     }
 } // namespace Jump
 
 namespace Jalr {
-    [[maybe_unused]]
+    /**
+     * A call (_Call) records its return site in the return stack, which is
+     * only cached (_Cached) if in the same page, and a return (_Return) jumps
+     * to the cached site directly on a hit.
+     */
+    template <bool _Discard = false, bool _Call = false, bool _Return = false, bool _Cached = true>
     static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
 
         auto target = (rs1 + imm) & ~1;
-        auto offset = target - rf.get_pc();
 
-        rd = rf.get_pc() + 4;
+        if constexpr (!_Discard) rd = rf.get_pc() + 4;
+        if constexpr (_Call) dev.ras.push(rf.get_pc() + 4, _Cached ? &exe + 1 : nullptr);
         rf.set_pc(target);
         dev.counter.jalr++;
 
-        return exe.next(offset);
+        if constexpr (_Return)
+            if (auto *next = dev.ras.pop(target)) return Hint { next, true };
+
+        return Hint {};
     }
 } // namespace Jalr
 
 namespace Lui {
-    [[maybe_unused]]
-    static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
+    template <bool _Discard = false, bool _Count = true>
+    static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-        rd = imm;
-        dev.counter.lui++;
-        return exe.next();
+        if constexpr (!_Discard) rd = imm;
+        if constexpr (_Count) dev.counter.lui++;
+        return exe.next(rf, mem, dev);
     }
 } // namespace Lui
 
 namespace Auipc {
-    [[maybe_unused]]
-    static auto fn(Executable &exe, RegisterFile &rf, Memory &, Device &dev) {
+    template <bool _Discard = false, bool _Count = true>
+    static auto fn(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) {
         auto &&[rd, rs1, rs2, imm] = exe.get_meta().parse(rf);
-        rd = rf.get_pc() + imm;
-        dev.counter.auipc++;
-        return exe.next();
+        if constexpr (!_Discard) rd = imm; // pc is folded into imm at compile time
+        if constexpr (_Count) dev.counter.auipc++;
+        return exe.next(rf, mem, dev);
     }
 } // namespace Auipc
 
@@ -0,0 +1,2 @@
+// Should only be included in interpretor/backend.cpp
+#include <simulation/implement/histogram_impl.h>
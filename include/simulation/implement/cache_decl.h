@@ -0,0 +1,85 @@
+#include <declarations.h>
+#include <config/counter.h>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+/**
+ * A set-associative cache, which only keeps the tags of lines.
+ * Both loads and stores allocate a line on a miss.
+ */
+struct Cache {
+  public:
+    enum class Policy { LRU, PLRU };
+
+    // Parse from a string of <size>:<ways>:<line>:<policy> (see --l1d).
+    explicit Cache(std::string_view, std::size_t size);
+
+    // Access the line of addr. Return whether it hits.
+    bool access(target_size_t);
+
+    auto get_hits()   const -> std::size_t { return this->hits; }
+    auto get_misses() const -> std::size_t { return this->misses; }
+    auto get_line_bits() const -> target_size_t { return this->line_bits; }
+    // A short description of the configuration.
+    auto describe() const -> std::string;
+
+  private:
+    std::size_t size;
+    std::size_t ways    = 8;
+    std::size_t line    = 64;
+    Policy      policy  = Policy::LRU;
+
+    target_size_t line_bits {};
+    target_size_t set_mask  {};
+
+    std::vector <target_size_t> tags;   // Line number + 1 of each way, 0 if invalid.
+    std::vector <std::uint64_t> stamp;  // For LRU: the last access of each way.
+    std::vector <std::uint64_t> tree;   // For PLRU: the tree bits of each set.
+    std::uint64_t clock {};
+    target_size_t last  {};     // The line of the last access, which is always a hit.
+
+    std::size_t hits   {};
+    std::size_t misses {};
+
+    void touch(std::size_t, std::size_t);
+    auto victim(std::size_t) const -> std::size_t;
+};
+
+/* A disabled level, which is compiled out of the access path. */
+struct NoCache {};
+
+/**
+ * Split L1 instruction and data caches, backed by a shared L2.
+ * Each level is either a Cache or a NoCache, and a disabled level
+ * is simply skipped, so that it costs nothing.
+ */
+template <typename _L1I, typename _L1D, typename _L2>
+struct CacheHierarchy {
+  public:
+    [[no_unique_address]] _L1I l1i;
+    [[no_unique_address]] _L1D l1d;
+    [[no_unique_address]] _L2  l2;
+
+    explicit CacheHierarchy(_L1I l1i, _L1D l1d, _L2 l2) :
+        l1i(std::move(l1i)), l1d(std::move(l1d)), l2(std::move(l2)) {}
+
+    // Fetch the line of addr.
+    void fetch(target_size_t, config::CounterCache &);
+    // Access the line of addr for a load/store.
+    void access(target_size_t, config::CounterCache &);
+    // The line size of fetches, in bits. Zero if no level is enabled.
+    auto get_fetch_bits() const -> target_size_t;
+    // The line size of loads/stores, in bits. Zero if no level is enabled.
+    auto get_data_bits() const -> target_size_t;
+
+  private:
+    template <std::size_t config::CounterCache::*_Miss, typename _L1>
+    void lookup(_L1 &, target_size_t, config::CounterCache &);
+};
+
+} // namespace dark
@@ -0,0 +1,179 @@
+#include <simulation/implement/cache_decl.h>
+#include <utility/cast.h>
+#include <utility/error.h>
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <fmtlib.h>
+
+namespace dark {
+
+inline Cache::Cache(std::string_view config, std::size_t size) : size(size) {
+    // Parse an integer, with an optional K/M suffix if it is a size.
+    const auto parse = [](std::string_view str, std::string_view what, bool suffix) {
+        std::size_t factor = 1;
+        if (suffix && (str.ends_with('K') || str.ends_with('k'))) {
+            factor = std::size_t(1) << 10;
+            str.remove_suffix(1);
+        } else if (suffix && (str.ends_with('M') || str.ends_with('m'))) {
+            factor = std::size_t(1) << 20;
+            str.remove_suffix(1);
+        }
+        auto val = sv_to_integer <std::size_t> (str);
+        panic_if(!val.has_value() || !std::has_single_bit(*val),
+            "Cache {} must be a power of 2: {}", what, str);
+        return *val * factor;
+    };
+
+    // Empty fields are left as default.
+    for (std::size_t which = 0 ; !config.empty() ; ++which) {
+        auto pos = config.find(':');
+        auto str = config.substr(0, pos);
+        config = pos == config.npos ? std::string_view {} : config.substr(pos + 1);
+        if (str.empty()) continue;
+        switch (which) {
+            case 0: this->size = parse(str, "size", true);  break;
+            case 1: this->ways = parse(str, "ways", false); break;
+            case 2: this->line = parse(str, "line", false); break;
+            case 3:
+                if (str == "lru") {
+                    this->policy = Policy::LRU;
+                } else if (str == "plru") {
+                    this->policy = Policy::PLRU;
+                } else {
+                    panic("Unknown cache policy: {}", str);
+                }
+                break;
+            default: panic("Too many fields in cache config");
+        }
+    }
+
+    panic_if(this->line < sizeof(target_size_t),
+        "Cache line must be at least {} bytes", sizeof(target_size_t));
+    panic_if(this->size < this->ways * this->line,
+        "Cache size is less than one set: {} < {} x {}", this->size, this->ways, this->line);
+    panic_if(this->policy == Policy::PLRU && this->ways > 64,
+        "PLRU cache supports at most 64 ways");
+
+    const auto sets = this->size / (this->ways * this->line);
+    this->line_bits = std::countr_zero(this->line);
+    this->set_mask  = sets - 1;
+    this->tags.resize(sets * this->ways);
+    if (this->policy == Policy::LRU) {
+        this->stamp.resize(sets * this->ways);
+    } else {
+        this->tree.resize(sets);
+    }
+}
+
+inline auto Cache::access(target_size_t addr) -> bool {
+    const target_size_t tag = (addr >> this->line_bits) + 1;
+    // Touching the most recent line again changes nothing in either policy.
+    if (tag == this->last) return ++this->hits, true;
+    this->last = tag;
+
+    const std::size_t   set = (tag - 1) & this->set_mask;
+
+    auto *const way = this->tags.data() + set * this->ways;
+    for (std::size_t i = 0 ; i < this->ways ; ++i) {
+        if (way[i] == tag) {
+            this->touch(set, i);
+            this->hits++;
+            return true;
+        }
+    }
+
+    const auto which = this->victim(set);
+    way[which] = tag;
+    this->touch(set, which);
+    this->misses++;
+    return false;
+}
+
+inline auto Cache::touch(std::size_t set, std::size_t which) -> void {
+    if (this->policy == Policy::LRU) {
+        this->stamp[set * this->ways + which] = ++this->clock;
+    } else {
+        // Walk down from the root, and point each node away from the way.
+        auto &bits = this->tree[set];
+        std::size_t node = 1;
+        for (std::size_t half = this->ways >> 1 ; half != 0 ; half >>= 1) {
+            const bool right = (which & half) != 0;
+            if (right) {
+                bits &= ~(std::uint64_t(1) << node);
+            } else {
+                bits |= (std::uint64_t(1) << node);
+            }
+            node = node * 2 + right;
+        }
+    }
+}
+
+inline auto Cache::victim(std::size_t set) const -> std::size_t {
+    if (this->policy == Policy::LRU) {
+        // Invalid ways are never touched, so they are taken first.
+        const auto *begin = this->stamp.data() + set * this->ways;
+        return std::min_element(begin, begin + this->ways) - begin;
+    } else {
+        const auto bits = this->tree[set];
+        std::size_t node = 1;
+        while (node < this->ways) node = node * 2 + ((bits >> node) & 1);
+        return node - this->ways;
+    }
+}
+
+inline auto Cache::describe() const -> std::string {
+    return std::format("{} bytes, {}-way, {} bytes per line, {}",
+        this->size, this->ways, this->line, this->policy == Policy::LRU ? "lru" : "plru");
+}
+
+template <typename _L1I, typename _L1D, typename _L2>
+inline void CacheHierarchy <_L1I, _L1D, _L2>::fetch
+    (target_size_t addr, config::CounterCache &counter) {
+    this->template lookup <&config::CounterCache::l1i_miss> (this->l1i, addr, counter);
+}
+
+template <typename _L1I, typename _L1D, typename _L2>
+inline void CacheHierarchy <_L1I, _L1D, _L2>::access
+    (target_size_t addr, config::CounterCache &counter) {
+    this->template lookup <&config::CounterCache::l1d_miss> (this->l1d, addr, counter);
+}
+
+template <typename _L1I, typename _L1D, typename _L2>
+template <std::size_t config::CounterCache::*_Miss, typename _L1>
+inline void CacheHierarchy <_L1I, _L1D, _L2>::lookup
+    (_L1 &l1, target_size_t addr, config::CounterCache &counter) {
+    if constexpr (std::same_as <_L1, Cache>) {
+        if (l1.access(addr)) return;
+        ++(counter.*_Miss);
+    }
+    if constexpr (std::same_as <_L2, Cache>) {
+        if (!this->l2.access(addr)) ++counter.l2_miss;
+    }
+}
+
+template <typename _L1I, typename _L1D, typename _L2>
+inline auto CacheHierarchy <_L1I, _L1D, _L2>::get_fetch_bits() const -> target_size_t {
+    // Lines are of the first level that instructions go through.
+    if constexpr (std::same_as <_L1I, Cache>) {
+        return this->l1i.get_line_bits();
+    } else if constexpr (std::same_as <_L2, Cache>) {
+        return this->l2.get_line_bits();
+    } else {
+        return 0;
+    }
+}
+
+template <typename _L1I, typename _L1D, typename _L2>
+inline auto CacheHierarchy <_L1I, _L1D, _L2>::get_data_bits() const -> target_size_t {
+    // Lines are of the first level that data go through.
+    if constexpr (std::same_as <_L1D, Cache>) {
+        return this->l1d.get_line_bits();
+    } else if constexpr (std::same_as <_L2, Cache>) {
+        return this->l2.get_line_bits();
+    } else {
+        return 0;
+    }
+}
+
+} // namespace dark
@@ -0,0 +1,31 @@
+#include <interpreter/device.h>
+#include <interpreter/memory.h>
+#include <config/counter.h>
+#include <vector>
+
+namespace dark {
+
+/**
+ * Run counts of each block, so that counters are updated once per
+ * flush, rather than once per command or block execution.
+ * A block execution only bumps its own count, and the counters of
+ * its commands are expanded from the text on flush.
+ */
+struct BlockHistogram {
+    explicit BlockHistogram(Memory &);
+    // Count one run of the block of size at pc.
+    void count(target_size_t, std::size_t);
+    // Count a single command at pc, which is in some block body.
+    static void count(target_size_t, Memory &, Device &);
+    // Add the runs counted so far to the counters.
+    void flush(Memory &, Device &);
+  private:
+    struct _Entry_t {
+        std::size_t runs;
+        std::size_t size;
+    };
+
+    std::vector <_Entry_t> table; // Indexed by the block head.
+};
+
+} // namespace dark
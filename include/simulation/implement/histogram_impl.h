@@ -0,0 +1,35 @@
+#include <simulation/implement/histogram_decl.h>
+#include <interpreter/interval.h>
+#include <riscv/abi.h>
+
+namespace dark {
+
+// This function is implemented in interpreter/executable.cpp
+auto get_counter(command_size_t) -> std::size_t config::Counter::*;
+
+inline BlockHistogram::BlockHistogram(Memory &mem) :
+    table((mem.get_text_range().finish - kTextStart) / sizeof(command_size_t)) {}
+
+inline void BlockHistogram::count(target_size_t pc, std::size_t size) {
+    // The size of a block at some head never changes.
+    auto &entry = this->table[(pc - kTextStart) / sizeof(command_size_t)];
+    entry.runs += 1;
+    entry.size  = size;
+}
+
+inline void BlockHistogram::count(target_size_t pc, Memory &mem, Device &dev) {
+    ++(dev.counter.*get_counter(mem.load_cmd(pc)));
+}
+
+inline void BlockHistogram::flush(Memory &mem, Device &dev) {
+    for (std::size_t i = 0 ; i < this->table.size() ; ++i) {
+        auto &[runs, size] = this->table[i];
+        if (runs == 0) continue;
+        const auto pc = kTextStart + i * sizeof(command_size_t);
+        for (std::size_t j = 0 ; j < size ; ++j)
+            dev.counter.*get_counter(mem.load_cmd(pc + j * sizeof(command_size_t))) += runs;
+        runs = 0;
+    }
+}
+
+} // namespace dark
@@ -4,15 +4,26 @@
 #include <libc/libc.h>
 #include <utility.h>
 #include <memory>
+#include <vector>
 
 namespace dark {
 
 struct ICache {
     explicit ICache(Memory &);
     auto ifetch(target_size_t, Hint) noexcept -> Executable &;
+    void print_details(bool) const;
   private:
-    const std::size_t length;
-    std::unique_ptr <Executable[]> cached;
+    static constexpr std::size_t kPageSlots = Executable::kPageSize / sizeof(command_size_t);
+
+    using _Page_t = std::unique_ptr <Executable[]>;
+
+    const std::size_t length;       // Number of commands in the text.
+    std::vector <_Page_t> pages;    // Pages are allocated on first touch.
+    Executable *current;            // The page of the last ifetch.
+    std::size_t touched;            // Number of pages allocated.
+
+    auto make_page(std::size_t) -> _Page_t;
+    auto lookup(target_size_t) noexcept -> Executable &;
 };
 
 } // namespace dark
@@ -5,19 +5,20 @@ namespace dark {
 // This function is implemented in interpreter/executable.cpp
 Function_t compile_once;
 
-static auto make_icache_range(Memory &mem) -> target_size_t {
+static auto make_icache_range(Memory &mem) -> std::size_t {
     auto text = mem.get_text_range();
     runtime_assert(text.start == libc::kLibcEnd);
     static_assert(libc::kLibcStart == kTextStart);
     const auto size = text.finish - libc::kLibcStart;
     runtime_assert(size % sizeof(command_size_t) == 0);
-    return text.finish;
+    return size / sizeof(command_size_t);
 }
 
 [[maybe_unused]]
 static auto compile_always(Executable &, RegisterFile &rf, Memory &mem, Device &dev) {
     Executable exe { compile_once, {} };
-    return exe(rf, mem, dev);
+    exe(rf, mem, dev);
+    return Hint {}; // exe is a temporary, so its hint is meaningless.
 }
 
 [[maybe_unused]]
@@ -30,33 +31,72 @@ static auto handle_cache_miss() -> Executable & {
  * We assume the layout as below:
  * - libc functions:
  * - normal text
+ * 
+ * Pages are only allocated when some command in it is fetched,
+ * since most programs only run a small fraction of the text.
+ * Each page has one more padding slot at the end, so that
+ * the fall-through hint of the last command stays in the page.
  */
-inline ICache::ICache(Memory &mem) : length(make_icache_range(mem)) {
-    const auto reserved = this->length / sizeof(Executable);
-    const auto libcsize = std::size(libc::funcs);
+inline ICache::ICache(Memory &mem) :
+    length(make_icache_range(mem)),
+    pages((this->length + kPageSlots - 1) / kPageSlots),
+    current(), touched() {
+    // The first page holds libc functions, which is always needed.
+    this->pages[0] = this->make_page(0);
+    this->current  = this->pages[0].get();
+}
+
+inline auto ICache::make_page(std::size_t index) -> _Page_t {
+    auto page = std::make_unique <Executable[]> (kPageSlots + 1);
 
-    // Initialize the cache
-    this->cached = std::make_unique<Executable[]>(reserved);
+    // Commands are left as compile_once
+    for (std::size_t i = 0 ; i < kPageSlots ; ++i)
+        page[i].set_handle(compile_once, {});
 
     // libc functions
-    for (std::size_t i = 0 ; i < libcsize ; ++i)
-        this->cached[i].set_handle(libc::funcs[i], {});
+    if (index == 0) {
+        const auto libcsize = std::size(libc::funcs);
+        static_assert(std::size(libc::funcs) <= kPageSlots);
+        for (std::size_t i = 0 ; i < libcsize ; ++i)
+            page[i].set_handle(libc::funcs[i], {});
+    }
 
-    // Other functions are left as compile_once
-    for (std::size_t i = libcsize ; i < reserved ; ++i)
-        this->cached[i].set_handle(compile_once, {});
+    this->touched += 1;
+    return page;
 }
 
-/* ifetch with some hint */
-inline auto ICache::ifetch(target_size_t pc, Hint hint) noexcept -> Executable & {
-    if (std::size_t(hint.next - this->cached.get()) < this->length)
-        [[likely]] return *hint.next;
-
+inline auto ICache::lookup(target_size_t pc) noexcept -> Executable & {
     std::size_t which = (pc - kTextStart) / sizeof(command_size_t);
     if (pc % alignof(command_size_t) != 0 || which >= this->length)
         return handle_cache_miss();
 
-    return this->cached[which];
+    auto &page = this->pages[which / kPageSlots];
+    if (page == nullptr) [[unlikely]]
+        page = this->make_page(which / kPageSlots);
+
+    this->current = page.get();
+    return page[which % kPageSlots];
+}
+
+/**
+ * ifetch with some hint. Direct hints are known to be valid
+ * (in-page chains, or return sites from the return stack).
+ * Others are only trusted within the current page.
+ *
+ * A direct return may leave current stale. This is still safe,
+ * as other hints never leave the page (with padding) they come from,
+ * so they can never fall into a stale page by accident.
+ */
+inline auto ICache::ifetch(target_size_t pc, Hint hint) noexcept -> Executable & {
+    if (hint.direct) [[likely]] return *hint.next;
+    if (std::size_t(hint.next - this->current) < kPageSlots)
+        [[likely]] return *hint.next;
+    return this->lookup(pc);
+}
+
+inline void ICache::print_details(bool) const {
+    console::profile << std::format(
+        "ICache pages touched: {}/{}\n", this->touched, this->pages.size());
 }
 
 } // namespace dark
@@ -1,37 +1,125 @@
 #include <declarations.h>
-#include <limits>
-#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace dark {
 
-/**
- * A simple 2 bit branch predictor.
- */
-// template <std::size_t _Nm = 4096>
-struct BranchPredictor {
-  private:
-    using _Data_t = std::uint8_t;
+/* Kinds of branch predictors (see --predictor). */
+namespace predictor {
 
-    static constexpr target_size_t _Nm    = 4096;
-    static constexpr target_size_t kBits  = 2;
-    static constexpr target_size_t kMask  = (1 << kBits) - 1;
+struct Bimodal;     // 2-bit counters indexed by pc.
+struct Gshare;      // 2-bit counters indexed by pc xor global history.
+struct Tournament;  // Bimodal and gshare, with a chooser indexed by pc.
+struct Tage;        // A bimodal base, with tagged tables of longer histories.
 
-    static constexpr target_size_t kDigit = std::numeric_limits<_Data_t>::digits;
-    static constexpr target_size_t kBytes = (_Nm * kBits) / kDigit;
+// Tables start either weakly taken, or random from a seed.
+struct Init {
+    bool weak;
+    std::uint32_t seed;
+};
 
-    static_assert(kBytes * kDigit == _Nm * kBits, "Invalid size");
+// A fixed seed by default, so that runs are reproducible.
+static constexpr std::uint32_t kDefaultSeed = 20240101;
 
-    std::array <_Data_t, kBytes> table;
+} // namespace predictor
 
-    static auto get_index(target_size_t) -> target_size_t;
+/**
+ * A branch predictor of some kind, with 2 ^ bits entries per table.
+ * The same initialization always gives the same predictions.
+ * Each kind is a specialization, so that it can be fully inlined.
+ */
+template <typename _Kind>
+struct BranchPredictor;
 
-    auto get_bits(target_size_t) const -> target_size_t;
-    auto set_bits(target_size_t, target_size_t) -> void;
+template <>
+struct BranchPredictor <predictor::Bimodal> {
+  public:
+    explicit BranchPredictor(std::size_t bits, predictor::Init);
+    bool predict(target_size_t) const;
+    void update(target_size_t, bool);
+    auto describe() const -> std::string;
+  private:
+    target_size_t mask;
+    std::vector <std::uint8_t> table;
+};
 
+template <>
+struct BranchPredictor <predictor::Gshare> {
   public:
-    BranchPredictor();
+    explicit BranchPredictor(std::size_t bits, predictor::Init);
     bool predict(target_size_t) const;
     void update(target_size_t, bool);
+    auto describe() const -> std::string;
+  private:
+    target_size_t mask;
+    target_size_t history;
+    std::vector <std::uint8_t> table;
+
+    auto get_index(target_size_t) const -> target_size_t;
+};
+
+template <>
+struct BranchPredictor <predictor::Tournament> {
+  public:
+    explicit BranchPredictor(std::size_t bits, predictor::Init);
+    bool predict(target_size_t) const;
+    void update(target_size_t, bool);
+    auto describe() const -> std::string;
+  private:
+    BranchPredictor <predictor::Bimodal> local;
+    BranchPredictor <predictor::Gshare>  global;
+    BranchPredictor <predictor::Bimodal> chooser;   // Taken means to use global.
+};
+
+template <>
+struct BranchPredictor <predictor::Tage> {
+  public:
+    explicit BranchPredictor(std::size_t bits, predictor::Init);
+    bool predict(target_size_t) const;
+    void update(target_size_t, bool);
+    auto describe() const -> std::string;
+  private:
+    static constexpr std::size_t kTables = 4;
+    static constexpr std::size_t kLength[kTables] = { 5, 11, 22, 44 };
+    static constexpr std::size_t kTagBits = 8;
+
+    struct _Entry_t {
+        std::uint8_t ctr;       // 3-bit counter, taken if >= 4.
+        std::uint8_t tag;
+        std::uint8_t useful;    // 2-bit counter.
+    };
+
+    // The provider (longest matching table) and the alternate prediction.
+    struct _Lookup_t {
+        target_size_t index[kTables];
+        std::uint8_t tag[kTables];
+        std::size_t provider;   // kTables if no table matches.
+        bool pred;
+        bool alt;
+    };
+
+    std::size_t bits;
+    std::uint64_t history;
+    // The latest history of a table, folded into some bits by xor of its chunks.
+    // It is kept up to date on update, instead of folded again on each lookup.
+    struct _Fold_t {
+        target_size_t value;
+        std::uint8_t width;
+        std::uint8_t out;       // Where the oldest bit lands, once shifted.
+    };
+
+    // Each table folds into the index, and into the tag in two widths.
+    _Fold_t folded[kTables][3];
+    BranchPredictor <predictor::Bimodal> base;
+    std::vector <_Entry_t> tables[kTables];
+
+    // The lookup of the last prediction, reused by the update right after.
+    mutable _Lookup_t last;
+    mutable target_size_t last_pc;
+
+    void lookup(target_size_t) const;   // Into last.
 };
 
 } // namespace dark
@@ -1,55 +1,205 @@
 #include <simulation/implement/predictor_decl.h>
+#include <fmtlib.h>
+#include <algorithm>
 #include <random>
 
 namespace dark {
 
-template <std::size_t _Div>
-static auto div_mod(target_size_t index) {
-    return std::make_pair(index / _Div, index % _Div);
+namespace predictor {
+
+// Fill a table of 2-bit counters, weakly taken or random.
+inline void fill_table(std::vector <std::uint8_t> &table, Init init) {
+    if (init.weak) {
+        std::ranges::fill(table, 2);
+    } else {
+        std::mt19937 gen(init.seed);
+        for (auto &entry : table) entry = gen() & 3;
+    }
 }
 
-inline BranchPredictor::BranchPredictor() : table() {
-    // Fill the table with random bits
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    for (auto &entry : this->table) entry = gen();
+// Move a saturating counter toward taken or not taken.
+inline void saturate(std::uint8_t &ctr, bool taken, std::uint8_t max) {
+    if (taken) {
+        if (ctr != max) ++ctr;
+    } else {
+        if (ctr != 0) --ctr;
+    }
 }
 
-inline auto BranchPredictor::predict(target_size_t pc) const -> bool {
-    auto index = this->get_index(pc);
-    constexpr auto kHalf = kMask >> 1;
-    return this->get_bits(index) > kHalf;
+inline auto get_pc_index(target_size_t pc) -> target_size_t {
+    static_assert(sizeof(command_size_t) == 4);
+    return pc / sizeof(command_size_t);
 }
 
-inline auto BranchPredictor::update(target_size_t pc, bool taken) -> void {
-    const auto index    = this->get_index(pc);
-    const auto data     = this->get_bits(index);
+} // namespace predictor
 
-    constexpr auto kMax = kMask;
-    constexpr auto kMin = target_size_t {0};
+/* Bimodal */
 
-    if (taken) {
-        if (data != kMax)
-            this->set_bits(index, (data + 1) ^ data);
-    } else {
-        if (data != kMin)
-            this->set_bits(index, (data - 1) ^ data);
+inline BranchPredictor <predictor::Bimodal>::BranchPredictor(std::size_t bits, predictor::Init init) :
+    mask((target_size_t(1) << bits) - 1), table(std::size_t(1) << bits) {
+    predictor::fill_table(this->table, init);
+}
+
+inline auto BranchPredictor <predictor::Bimodal>::predict(target_size_t pc) const -> bool {
+    return this->table[predictor::get_pc_index(pc) & this->mask] >= 2;
+}
+
+inline auto BranchPredictor <predictor::Bimodal>::update(target_size_t pc, bool taken) -> void {
+    predictor::saturate(this->table[predictor::get_pc_index(pc) & this->mask], taken, 3);
+}
+
+inline auto BranchPredictor <predictor::Bimodal>::describe() const -> std::string {
+    return std::format("bimodal, {} entries", this->table.size());
+}
+
+/* Gshare */
+
+inline BranchPredictor <predictor::Gshare>::BranchPredictor(std::size_t bits, predictor::Init init) :
+    mask((target_size_t(1) << bits) - 1), history(), table(std::size_t(1) << bits) {
+    predictor::fill_table(this->table, init);
+}
+
+inline auto BranchPredictor <predictor::Gshare>::get_index(target_size_t pc) const -> target_size_t {
+    return (predictor::get_pc_index(pc) ^ this->history) & this->mask;
+}
+
+inline auto BranchPredictor <predictor::Gshare>::predict(target_size_t pc) const -> bool {
+    return this->table[this->get_index(pc)] >= 2;
+}
+
+inline auto BranchPredictor <predictor::Gshare>::update(target_size_t pc, bool taken) -> void {
+    predictor::saturate(this->table[this->get_index(pc)], taken, 3);
+    this->history = ((this->history << 1) | taken) & this->mask;
+}
+
+inline auto BranchPredictor <predictor::Gshare>::describe() const -> std::string {
+    return std::format("gshare, {} entries", this->table.size());
+}
+
+/* Tournament */
+
+// Each table gets its own seed, so that they do not start the same.
+inline BranchPredictor <predictor::Tournament>::BranchPredictor(std::size_t bits, predictor::Init init) :
+    local(bits, init),
+    global(bits, { init.weak, init.seed + 1 }),
+    chooser(bits, { init.weak, init.seed + 2 }) {}
+
+inline auto BranchPredictor <predictor::Tournament>::predict(target_size_t pc) const -> bool {
+    return this->chooser.predict(pc) ? this->global.predict(pc) : this->local.predict(pc);
+}
+
+inline auto BranchPredictor <predictor::Tournament>::update(target_size_t pc, bool taken) -> void {
+    const auto by_local  = this->local.predict(pc);
+    const auto by_global = this->global.predict(pc);
+    // Only train the chooser when the two disagree.
+    if (by_local != by_global) this->chooser.update(pc, by_global == taken);
+    this->local.update(pc, taken);
+    this->global.update(pc, taken);
+}
+
+inline auto BranchPredictor <predictor::Tournament>::describe() const -> std::string {
+    return std::format("tournament of {} and {}", this->local.describe(), this->global.describe());
+}
+
+/* TAGE */
+
+inline BranchPredictor <predictor::Tage>::BranchPredictor(std::size_t bits, predictor::Init init) :
+    bits(bits > 2 ? bits - 2 : 1), history(), folded(), base(bits, init), tables(), last(), last_pc(1) {
+    // Tagged tables are a quarter of the base each, and start weak and useless.
+    for (auto &table : this->tables)
+        table.assign(std::size_t(1) << this->bits, _Entry_t { .ctr = 3, .tag = 0, .useful = 0 });
+    for (std::size_t i = 0 ; i < kTables ; ++i) {
+        const std::size_t widths[] = { this->bits, kTagBits, kTagBits - 1 };
+        for (std::size_t j = 0 ; j < std::size(widths) ; ++j)
+            this->folded[i][j] = _Fold_t {
+                .value = 0,
+                .width = static_cast <std::uint8_t> (widths[j]),
+                .out   = static_cast <std::uint8_t> (kLength[i] % widths[j]),
+            };
     }
 }
 
-inline auto BranchPredictor::get_index(target_size_t pc) -> target_size_t {
-    static_assert(sizeof(command_size_t) == 4);
-    return ((pc / sizeof(command_size_t)) & (_Nm - 1)) * kBits;
+inline void BranchPredictor <predictor::Tage>::lookup(target_size_t pc) const {
+    const auto where = predictor::get_pc_index(pc);
+    const auto mask  = (target_size_t(1) << this->bits) - 1;
+
+    auto &result = this->last;
+    result.provider = kTables;
+    result.pred = result.alt = this->base.predict(pc);
+
+    for (std::size_t i = 0 ; i < kTables ; ++i) {
+        const auto &[fold_index, fold_tag, fold_alt] = this->folded[i];
+        const auto index = (where ^ (where >> this->bits) ^ fold_index.value) & mask;
+        const auto tag   = (where ^ (fold_tag.value << 1) ^ fold_alt.value) & ((1 << kTagBits) - 1);
+        result.index[i] = index;
+        result.tag[i]   = static_cast <std::uint8_t> (tag);
+        if (this->tables[i][index].tag == tag) {
+            // Tables go from short to long histories, so the last match provides.
+            result.alt  = result.pred;
+            result.pred = this->tables[i][index].ctr >= 4;
+            result.provider = i;
+        }
+    }
+
+    this->last_pc = pc;
 }
 
-inline auto BranchPredictor::get_bits(target_size_t index) const -> target_size_t {
-    const auto [which, offset] = div_mod <kDigit> (index);
-    return (this->table[which] >> offset) & kMask;
+inline auto BranchPredictor <predictor::Tage>::predict(target_size_t pc) const -> bool {
+    this->lookup(pc);
+    return this->last.pred;
+}
+
+inline auto BranchPredictor <predictor::Tage>::update(target_size_t pc, bool taken) -> void {
+    // An odd pc never matches, so that a stale lookup is never reused.
+    if (pc != this->last_pc) this->lookup(pc);
+    const auto &[index, tag, provider, pred, alt] = this->last;
+    this->last_pc = 1;
+
+    if (provider == kTables) {
+        this->base.update(pc, taken);
+    } else {
+        auto &entry = this->tables[provider][index[provider]];
+        if (pred != alt) predictor::saturate(entry.useful, pred == taken, 3);
+        predictor::saturate(entry.ctr, taken, 7);
+    }
+
+    // On a misprediction, allocate an entry with a longer history.
+    if (pred != taken) {
+        const auto first = provider == kTables ? 0 : provider + 1;
+        bool allocated = false;
+        for (std::size_t i = first ; i < kTables ; ++i) {
+            auto &entry = this->tables[i][index[i]];
+            if (entry.useful == 0) {
+                entry = _Entry_t { .ctr = std::uint8_t(taken ? 4 : 3), .tag = tag[i], .useful = 0 };
+                allocated = true;
+                break;
+            }
+        }
+        if (!allocated) {
+            for (std::size_t i = first ; i < kTables ; ++i)
+                predictor::saturate(this->tables[i][index[i]].useful, false, 3);
+        }
+    }
+
+    // Shift the new outcome into each fold, and the oldest bit of the table out.
+    // A fold is the xor of the width-bit chunks of the latest length bits, so
+    // shifting the history rotates it, with the bit at the width wrapping around.
+    for (std::size_t i = 0 ; i < kTables ; ++i) {
+        const auto out = static_cast <target_size_t> ((this->history >> (kLength[i] - 1)) & 1);
+        for (auto &fold : this->folded[i]) {
+            auto value = (fold.value << 1) | static_cast <target_size_t> (taken);
+            value ^= out << fold.out;
+            value ^= value >> fold.width;
+            fold.value = value & ((target_size_t(1) << fold.width) - 1);
+        }
+    }
+
+    this->history = (this->history << 1) | taken;
 }
 
-inline auto BranchPredictor::set_bits(target_size_t index, target_size_t delta) -> void {
-    const auto [which, offset] = div_mod <kDigit> (index);
-    this->table[which] ^= (delta << offset);
+inline auto BranchPredictor <predictor::Tage>::describe() const -> std::string {
+    return std::format("tage of {}, with {} x {} tagged entries",
+        this->base.describe(), kTables, std::size_t(1) << this->bits);
 }
 
 } // namespace dark
@@ -0,0 +1,51 @@
+#pragma once
+#include <interpreter/forward.h>
+#include <interpreter/interval.h>
+#include <array>
+#include <utility>
+
+namespace dark {
+
+/**
+ * A tiny cache of the memory regions which served the latest accesses,
+ * most recent first. Stack-heavy and array-heavy loops keep hitting
+ * the same one or two regions, which costs one compare and an add.
+ */
+struct RegionCache {
+    struct Region {
+        Interval    range {};
+        std::byte * base  {};   // Host address of guest address 0.
+    };
+
+    std::array <Region, 2> entry {};
+    // Hits are not counted, since every access that is not a miss hits.
+    std::size_t misses  {};
+
+    /**
+     * Check [addr, addr + size) against a range in one compare,
+     * which never overflows even near the top of address space.
+     */
+    static bool in_window(Interval range, target_size_t addr, std::size_t size) {
+        return std::size_t(addr - range.start) + size <= std::size_t(range.finish - range.start);
+    }
+
+    auto find(target_size_t addr, std::size_t size) -> std::byte * {
+        if (in_window(entry[0].range, addr, size))
+            return entry[0].base + addr;
+        if (in_window(entry[1].range, addr, size)) {
+            std::swap(entry[0], entry[1]);
+            return entry[0].base + addr;
+        }
+        return nullptr;
+    }
+
+    void insert(Region region) {
+        entry[1] = entry[0];
+        entry[0] = region;
+    }
+
+    // Must be called once any region moves or shrinks.
+    void clear() { entry = {}; }
+};
+
+} // namespace dark
@@ -0,0 +1,45 @@
+#pragma once
+#include <interpreter/forward.h>
+#include <array>
+
+namespace dark {
+
+/**
+ * A shadow return address stack, which caches the executable
+ * of the return site for each call. It only speeds up dispatch,
+ * and has no effect on the simulated profile.
+ *
+ * It is a ring buffer, so deep recursion just overwrites
+ * the oldest entries, which will then miss and fall back.
+ */
+struct ReturnStack {
+  private:
+    static constexpr std::size_t _Nm    = 16;
+    static constexpr std::size_t kMask  = _Nm - 1;
+
+    static_assert((_Nm & kMask) == 0, "Size must be a power of 2");
+
+    struct Entry {
+        target_size_t   pc  {};
+        Executable *    exe {};
+    };
+
+    std::array <Entry, _Nm> stack {};
+    std::size_t top {};
+
+  public:
+    /* Record the return site of a call. exe may be null if unknown. */
+    void push(target_size_t pc, Executable *exe) {
+        this->top = (this->top + 1) & kMask;
+        this->stack[this->top] = { pc, exe };
+    }
+
+    /* Return the cached executable if the return target matches, or null. */
+    auto pop(target_size_t pc) -> Executable * {
+        const auto entry = this->stack[this->top];
+        this->top = (this->top - 1) & kMask;
+        return entry.pc == pc ? entry.exe : nullptr;
+    }
+};
+
+} // namespace dark
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace dark {
+
+/**
+ * The expected output in oj-mode, mapped from the answer file.
+ * Output is checked piece by piece as it is flushed, so a wrong answer
+ * is caught at the first mismatch, or once the output gets too long.
+ */
+struct AnswerChecker {
+  public:
+    // Return nullptr if the answer file cannot be mapped.
+    static auto create(std::string_view path) -> std::unique_ptr <AnswerChecker>;
+
+    // Check the next piece of output. Once failed, always fails.
+    bool check(std::string_view);
+    // Whether any output has mismatched so far.
+    bool has_failed() const { return this->failed; }
+    // Whether the output is exactly the whole answer.
+    bool is_accepted() const { return !this->failed && this->offset == this->size; }
+
+    AnswerChecker(const AnswerChecker &) = delete;
+    ~AnswerChecker();
+  private:
+    const char *const data;
+    std::size_t const size;
+    std::size_t offset;
+    bool failed;
+
+    explicit AnswerChecker(const char *data, std::size_t size);
+};
+
+} // namespace dark
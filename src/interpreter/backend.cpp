@@ -4,11 +4,18 @@
 #include <interpreter/register.h>
 #include <interpreter/exception.h>
 #include <interpreter/executable.h>
+#include <interpreter/jit.h>
 #include <simulation/icache.h>
+#include <simulation/histogram.h>
 #include <linker/layout.h>
 #include <config/config.h>
+#include <config/default.h>
 #include <libc/libc.h>
+#include <algorithm>
 #include <map>
+#include <optional>
+#include <ostream>
+#include <streambuf>
 
 namespace dark {
 
@@ -32,16 +39,137 @@ struct LabelMap {
     }
 };
 
+/**
+ * The instruction and cycle limits of a run. The loops count down a quota
+ * of instructions, which is refilled once used up. Cycles are only computed
+ * on refill, and a quota never exceeds the instructions that surely fit in
+ * the remaining cycles, so the cycle limit is caught soon after exceeded.
+ */
+struct Budget {
+  private:
+    std::size_t time;           // Instructions not given out yet.
+    std::size_t const limit;    // Maximum cycles.
+    std::size_t const weight;   // The largest weight.
+    const Device &dev;
+
+  public:
+    explicit Budget(const Config &config, const Device &dev) :
+        time(config.get_timeout()), limit(config.get_cycle_limit()),
+        weight(dev.get_max_weight()), dev(dev) {}
+
+    /**
+     * Give out more instructions, on top of some given out but not used yet,
+     * which also count against the remaining cycles. Panic if no time left.
+     */
+    auto refill(std::size_t granted = 0) -> std::size_t {
+        auto quota = this->time;
+        if (this->limit != config::kInitCycleLimit && this->weight != 0) {
+            const auto cycles = this->dev.get_cycles();
+            panic_if(cycles > this->limit, "Cycle Limit Exceeded");
+            const auto fit = (this->limit - cycles) / this->weight + 1;
+            quota = std::min(quota, fit - std::min(fit, granted));
+        }
+        panic_if(quota == 0 && granted == 0, "Time Limit Exceeded");
+        this->time -= quota;
+        return quota;
+    }
+
+    /* Give out up to n more instructions, regardless of the cycle limit. */
+    auto take(std::size_t n) -> std::size_t {
+        n = std::min(n, this->time);
+        this->time -= n;
+        return n;
+    }
+
+    /* Check the cycle limit at the end of the run. */
+    void finish() const {
+        if (this->limit == config::kInitCycleLimit) return;
+        panic_if(this->dev.get_cycles() > this->limit, "Cycle Limit Exceeded");
+    }
+};
+
 static void simulate_normal
-    (RegisterFile &rf, Memory &mem, Device &dev, std::size_t timeout) {
-    ICache icache { mem };
+    (ICache &icache, RegisterFile &rf, Memory &mem, Device &dev, Budget &budget) {
     try {
         Hint hint {};
-        while (rf.advance() && timeout --> 0) {
+        std::size_t quota = 0;
+        while (rf.advance()) {
+            if (quota == 0) quota = budget.refill();
+            quota -= 1;
             auto &exe = icache.ifetch(rf.get_pc(), hint);
             hint = exe(rf, mem, dev);
         }
-        panic_if(timeout + 1 == 0, "Time Limit Exceeded");
+        budget.finish();
+    } catch (FailToInterpret &e) {
+        panic("{}", e.what(rf, mem, dev));
+    } catch (std::exception &e) {
+        unreachable(std::format("std::exception caught: {}\n", e.what()));
+    }
+}
+
+/**
+ * Run the straight-line body of a block in one dispatch,
+ * natively if the JIT is enabled and the block is hot.
+ * The block terminator is left to the next round.
+ * If hist is given, the body does not count by itself,
+ * and its counters are only added on flush.
+ */
+static auto run_block(Executable &exe, std::size_t size, Jit *jit, BlockHistogram *hist,
+    RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
+    Hint hint { &exe + size };
+    if (jit != nullptr && jit->execute(exe, size, rf, mem, dev)) {
+        // The whole body is run in native code, which also counts in batch.
+    } else {
+        if constexpr (kThreadedDispatch) {
+            // Body commands are chained to each other.
+            hint = exe(rf, mem, dev);
+        } else {
+            auto *body = &exe;
+            for (std::size_t i = 0 ; i < size ; ++i) body[i](rf, mem, dev);
+        }
+        if (hist != nullptr) hist->count(rf.get_pc(), size);
+    }
+    rf.set_pc(rf.get_pc() + size * sizeof(command_size_t));
+    return hint;
+}
+
+static void simulate_block
+    (ICache &icache, Jit *jit, BlockHistogram *hist, RegisterFile &rf, Memory &mem, Device &dev, Budget &budget) {
+    try {
+        Hint hint {};
+        std::size_t quota = 0;
+        while (rf.advance()) {
+            auto &exe = icache.ifetch(rf.get_pc(), hint);
+            auto size = exe.get_block_size();
+            // Top up the quota for the whole block if possible.
+            if (quota < std::max <std::size_t> (size, 1)) {
+                // The cycle limit is checked on refill, so counters must be up to date.
+                if (hist != nullptr) hist->flush(mem, dev);
+                quota += budget.refill(quota);
+                // Threaded body commands cannot be split, so a block near the cycle
+                // limit still runs whole. The limit is checked on the next refill.
+                if constexpr (kThreadedDispatch)
+                    if (quota < size) quota += budget.take(size - quota);
+            }
+            // The whole block is fetched at once if it runs in one dispatch.
+            if (dev.cache.inst) dev.fetch(rf.get_pc(), size != 0 && size <= quota ? size : 1);
+            if (size == 0) {
+                quota -= 1;
+                hint = exe(rf, mem, dev);
+            } else if (size <= quota) {
+                quota -= size;
+                hint = run_block(exe, size, jit, hist, rf, mem, dev);
+            } else {
+                // Not enough time for the whole block, so fall back to single step.
+                // Threaded body commands cannot be split, so we give up at once.
+                panic_if(kThreadedDispatch, "Time Limit Exceeded");
+                quota -= 1;
+                hint = exe(rf, mem, dev);
+                if (hist != nullptr) BlockHistogram::count(rf.get_pc(), mem, dev);
+            }
+        }
+        if (hist != nullptr) hist->flush(mem, dev);
+        budget.finish();
     } catch (FailToInterpret &e) {
         panic("{}", e.what(rf, mem, dev));
     } catch (std::exception &e) {
@@ -52,6 +180,38 @@ static void simulate_normal
 static void simulate_debug
     (RegisterFile &regfile, Memory &memory, Device &device, std::size_t timeout);
 
+/**
+ * Ties the console streams to the program output during a run, so that the
+ * output so far goes out before any error or the profile, as a tied stream
+ * of the standard library would. Nothing is written to the tied stream,
+ * which only drains the output when flushed.
+ */
+struct OutputTie final : std::streambuf {
+  public:
+    explicit OutputTie(OutputBuffer &out) :
+        out(out), stream(this),
+        error(console::error.tie(&this->stream)),
+        profile(console::profile.tie(&this->stream)) {}
+    OutputTie(const OutputTie &) = delete;
+    auto operator=(const OutputTie &) -> OutputTie & = delete;
+    ~OutputTie() override {
+        console::error.tie(this->error);
+        console::profile.tie(this->profile);
+    }
+
+  private:
+    OutputBuffer &out;
+    std::ostream stream;
+    std::ostream *const error;
+    std::ostream *const profile;
+
+    // A wrong answer is kept in the checker, so draining never panics here.
+    auto sync() -> int override {
+        static_cast <void> (this->out.drain());
+        return 0;
+    }
+};
+
 void Interpreter::simulate() {
     auto &layout = this->memory_layout.get <MemoryLayout &>();
 
@@ -65,18 +225,36 @@ void Interpreter::simulate() {
 
     libc::libc_init(regfile, memory, device);
 
+    ICache icache { memory };
+    auto jit = Jit::create(config, memory);
+
+    std::optional <BlockHistogram> hist;
+    if (device.batch) hist.emplace(memory);
+
+    Budget budget { config, device };
+    OutputTie tie { device.out };
+
     if (config.has_option("debug")) {
         simulate_debug(regfile, memory, device, config.get_timeout());
+    } else if (kThreadedDispatch || config.has_option("block") || jit != nullptr || hist
+        || device.cache.inst) {
+        // Threaded dispatch, JIT and batch counters only work with block execution.
+        // The instruction cache also resolves fetches once per block there.
+        auto *hist_ptr = hist ? &*hist : nullptr;
+        simulate_block(icache, jit.get(), hist_ptr, regfile, memory, device, budget);
     } else {
-        simulate_normal(regfile, memory, device, config.get_timeout());
+        simulate_normal(icache, regfile, memory, device, budget);
     }
 
     console::profile << '\n';
 
     bool enable_detail = config.has_option("detail");
     regfile.print_details(enable_detail);
-    memory.print_details(enable_detail);
+    memory.print_details(enable_detail, device);
+    libc::print_details(enable_detail);
     device.print_details(enable_detail);
+    icache.print_details(enable_detail);
+    if (jit != nullptr) jit->print_details(enable_detail);
 }
 
 static void simulate_debug
@@ -1,19 +1,185 @@
 #include <interpreter/device.h>
 #include <simulation/predictor.h>
+#include <simulation/cache.h>
 #include <config/config.h>
+#include <config/weight.h>
 #include <utility.h>
 #include <utility/reflect.h>
-#include <optional>
+#include <utility/cast.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <variant>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace dark {
 
 using console::profile;
 
+using _Weight_Array_t = std::array <std::size_t, weight::kWeightCount>;
+
+// Counters are laid out in the same order as the weight ranges.
+static_assert(sizeof(config::Counter) == sizeof(_Weight_Array_t));
+
+// Weights are resolved in the order of counters, so a counter finds its own by offset.
+static auto get_weight(const _Weight_Array_t &weights,
+    const config::Counter &base, const std::size_t &counter) -> std::size_t {
+    const auto *from = reinterpret_cast <const std::byte *> (&base);
+    const auto *what = reinterpret_cast <const std::byte *> (&counter);
+    return weights[static_cast <std::size_t> (what - from) / sizeof(std::size_t)];
+}
+
+// Resolve the weight of each counter once, in the order of counters.
+static auto make_weights(const Config &config) -> _Weight_Array_t {
+    _Weight_Array_t weights {};
+    std::size_t which = 0;
+    for (const auto &[name, list, weight] : weight::kWeightRanges) {
+        for (auto item : list) {
+            if (weight == weight::kManual) item = weight::parse_manual(item).first;
+            weights[which++] = config.get_weight(item);
+        }
+    }
+    return weights;
+}
+
+template <bool _Enable>
+using _Level_t = std::conditional_t <_Enable, Cache, NoCache>;
+
+// Every combination of enabled levels, in the bits of l1i, l1d and l2.
+template <std::size_t ..._Is>
+static auto make_cache_variant(std::index_sequence <_Is...>) -> std::variant <
+    CacheHierarchy <_Level_t <(_Is & 4) != 0>, _Level_t <(_Is & 2) != 0>, _Level_t <(_Is & 1) != 0>>...>;
+
+using _Caches_t = decltype(make_cache_variant(std::make_index_sequence <8> {}));
+
+// Build the cache hierarchy level by level.
+template <typename ..._Levels>
+static auto make_caches(const Config &config, _Levels ...levels) -> _Caches_t {
+    constexpr auto which = sizeof...(_Levels);
+    if constexpr (which == 3) {
+        return CacheHierarchy <_Levels...> { std::move(levels)... };
+    } else {
+        constexpr std::pair <std::string_view, std::size_t> kLevels[] = {
+            { "l1i", 32 << 10 }, { "l1d", 32 << 10 }, { "l2", 256 << 10 },
+        };
+        const auto [name, size] = kLevels[which];
+        if (!config.has_option(name))
+            return make_caches(config, std::move(levels)..., NoCache {});
+        return make_caches(config, std::move(levels)..., Cache { config.get_option_value(name), size });
+    }
+}
+
+/**
+ * Fetch or access a line through the hierarchy in use,
+ * which is resolved once, rather than visited on every miss.
+ */
+using _Line_Fn_t = void(_Caches_t &, Device &, target_size_t);
+
+template <typename _Hierarchy>
+static void fetch_with(_Caches_t &caches, Device &dev, target_size_t addr) {
+    auto &hierarchy = *std::get_if <_Hierarchy> (&caches);
+    hierarchy.fetch(addr, dev.counter);
+    // With no L1D, data go to the L2, whose last line may have changed.
+    if constexpr (std::same_as <decltype(hierarchy.l1d), NoCache>)
+        dev.cache.data_line = target_size_t(-1);
+}
+
+template <typename _Hierarchy>
+static void access_with(_Caches_t &caches, Device &dev, target_size_t addr) {
+    std::get_if <_Hierarchy> (&caches)->access(addr, dev.counter);
+}
+
+using _Predictor_t = std::variant <std::monostate,
+    BranchPredictor <predictor::Bimodal>,
+    BranchPredictor <predictor::Gshare>,
+    BranchPredictor <predictor::Tournament>,
+    BranchPredictor <predictor::Tage>>;
+
+// Parse the predictor from a string of <kind>:<bits>:<init> (see --predictor).
+static auto make_predictor(const Config &config) -> _Predictor_t {
+    if (!config.has_option("predictor")) return {};
+
+    std::string_view fields[3] {};
+    auto value = config.get_option_value("predictor");
+    for (auto &field : fields) {
+        auto pos = value.find(':');
+        field = value.substr(0, pos);
+        value = pos == value.npos ? std::string_view {} : value.substr(pos + 1);
+    }
+    panic_if(!value.empty(), "Too many fields in predictor config");
+
+    const auto [kind, bits_str, init_str] = fields;
+
+    std::size_t bits = 12;
+    if (!bits_str.empty()) {
+        auto val = sv_to_integer <std::size_t> (bits_str);
+        panic_if(!val.has_value() || *val == 0 || *val > 24,
+            "Predictor bits must be an integer in [1, 24]: {}", bits_str);
+        bits = *val;
+    }
+
+    predictor::Init init { .weak = false, .seed = predictor::kDefaultSeed };
+    if (init_str == "weak") {
+        init.weak = true;
+    } else if (!init_str.empty()) {
+        auto val = sv_to_integer <std::uint32_t> (init_str);
+        panic_if(!val.has_value(), "Predictor init must be weak or a seed: {}", init_str);
+        init.seed = *val;
+    }
+
+    if (kind.empty() || kind == "bimodal")
+        return BranchPredictor <predictor::Bimodal> { bits, init };
+    if (kind == "gshare")
+        return BranchPredictor <predictor::Gshare> { bits, init };
+    if (kind == "tournament")
+        return BranchPredictor <predictor::Tournament> { bits, init };
+    if (kind == "tage")
+        return BranchPredictor <predictor::Tage> { bits, init };
+    panic("Unknown branch predictor: {}", kind);
+}
+
+// Parse the poison period from full, off or sampled:<period> (see --poison).
+static auto get_poison_period(const Config &config) -> std::size_t {
+    constexpr std::size_t kSampledPeriod = 64;
+    auto value = config.get_option_value("poison");
+    if (value.empty() || value == "full") return 1;
+    if (value == "off") return 0;
+    if (value == "sampled") return kSampledPeriod;
+    if (value.starts_with("sampled:")) {
+        value.remove_prefix(std::size("sampled:") - 1);
+        auto val = sv_to_integer <std::size_t> (value);
+        panic_if(!val.has_value() || *val == 0, "Poison period must be a positive integer: {}", value);
+        return *val;
+    }
+    panic("Unknown poison policy: {}", value);
+}
+
+// Program output is checked against the answer if any, or goes to the output file.
+static auto make_output(const Config &config) -> OutputBuffer {
+    if (auto *checker = config.get_answer_checker()) return OutputBuffer { *checker };
+    return OutputBuffer { config.get_output_fd() };
+}
+
+// Only the standard input may be fed by someone reading the output, as a terminal
+// or a pipe would. A regular file never waits, so its reads need no flush.
+static auto is_interactive(const std::istream &in) -> bool {
+    if (&in != &std::cin) return false;
+    struct ::stat info {};
+    return ::fstat(STDIN_FILENO, &info) != 0 || !S_ISREG(info.st_mode);
+}
+
 // Some hidden implementation data.
 struct Device_Impl {
-    std::size_t bp_failed;
-    std::optional <BranchPredictor> bp;
-    const Config &config;
+    _Predictor_t bp;
+    _Caches_t caches;
+    _Line_Fn_t *fetch_fn;      // See fetch_with.
+    _Line_Fn_t *access_fn;     // See access_with.
+    const _Weight_Array_t weights;
 };
 
 struct Device::Impl : Device, Device_Impl {
@@ -21,14 +187,39 @@ struct Device::Impl : Device, Device_Impl {
         : Device {
             .counter = {},
             .in = config.get_input_stream(),
-            .out = config.get_output_stream(),
+            .interactive = is_interactive(config.get_input_stream()),
+            .out = make_output(config),
+            .ras = {},
+            .batch = config.has_option("batch"),
+            .cache = {
+                .inst = config.has_option("l1i") || config.has_option("l2"),
+                .data = config.has_option("l1d") || config.has_option("l2"),
+                .line = target_size_t(-1),
+                .bits = {},
+                .fetched = {},
+                .lines = {},
+                .data_line = target_size_t(-1),
+                .data_bits = {},
+                .data_hits = {},
+            },
+            .poison = {
+                .period = get_poison_period(config),
+                .count = 0,
+            },
         }, Device_Impl {
-            .bp_failed = {},
-            .bp = {},
-            .config = config,
+            .bp = make_predictor(config),
+            .caches = make_caches(config),
+            .fetch_fn = {},
+            .access_fn = {},
+            .weights = make_weights(config),
         }
     {
-        if (config.has_option("predictor")) bp.emplace();
+        std::visit([this]<typename _Tp>(_Tp &caches) {
+            this->cache.bits        = caches.get_fetch_bits();
+            this->cache.data_bits   = caches.get_data_bits();
+            this->fetch_fn          = fetch_with <_Tp>;
+            this->access_fn         = access_with <_Tp>;
+        }, this->caches);
     }
 };
 
@@ -38,12 +229,29 @@ auto Device::create(const Config &config)
 }
 
 void Device::predict(target_size_t pc, bool what) {
-    auto &impl  = this->get_impl();
-    if (!impl.bp.has_value()) return;
-    auto &bp    = *impl.bp;
-    auto result = bp.predict(pc);
-    impl.bp_failed += (result != what);
-    bp.update(pc, what);
+    auto &impl = this->get_impl();
+    std::visit([&]<typename _Tp>(_Tp &bp) {
+        if constexpr (!std::same_as <_Tp, std::monostate>) {
+            impl.counter.mispredict += (bp.predict(pc) != what);
+            bp.update(pc, what);
+        }
+    }, impl.bp);
+}
+
+void Device::fetch_lines(target_size_t pc, target_size_t last) {
+    auto &impl = this->get_impl();
+    const auto bits = this->cache.bits;
+    for (auto line = pc >> bits ; line <= last ; ++line) {
+        if (line == this->cache.line) continue;
+        this->cache.line = line;
+        this->cache.lines += 1;
+        impl.fetch_fn(impl.caches, *this, line << bits);
+    }
+}
+
+void Device::access_line(target_size_t addr) {
+    auto &impl = this->get_impl();
+    impl.access_fn(impl.caches, *this, addr);
 }
 
 Device::~Device() {
@@ -63,67 +271,55 @@ auto Device::get_impl() -> Impl & {
     return *static_cast <Impl *> (this);
 }
 
+auto Device::get_cycles() const -> std::size_t {
+    const auto &impl = *static_cast <const Impl *> (this);
+    _Weight_Array_t counts;
+    std::memcpy(&counts, static_cast <const config::Counter *> (&impl.counter), sizeof(counts));
+    return std::inner_product(counts.begin(), counts.end(), impl.weights.begin(), std::size_t {});
+}
+
+auto Device::get_max_weight() const -> std::size_t {
+    const auto &impl = *static_cast <const Impl *> (this);
+    const auto &counter = static_cast <const config::Counter &> (impl.counter);
+    const auto weight_of = [&](const std::size_t &which) {
+        return get_weight(impl.weights, counter, which);
+    };
+
+    // Commands come before the cache and predictor events in the counters.
+    const auto commands = static_cast <std::size_t> (
+        reinterpret_cast <const std::byte *> (&counter.l1i_miss) -
+        reinterpret_cast <const std::byte *> (&counter)) / sizeof(std::size_t);
+    auto worst = std::ranges::max(std::span { impl.weights }.first(commands));
+
+    // Events are charged on top of the command: its fetch and its data access
+    // may both miss in every level, and a branch may be mispredicted.
+    std::visit([&]<typename _Tp>(const _Tp &) {
+        constexpr bool has_l1i = std::same_as <decltype(_Tp::l1i), Cache>;
+        constexpr bool has_l1d = std::same_as <decltype(_Tp::l1d), Cache>;
+        constexpr bool has_l2  = std::same_as <decltype(_Tp::l2),  Cache>;
+        const auto l2_miss = has_l2 ? weight_of(counter.l2_miss) : 0;
+        if (this->cache.inst) worst += (has_l1i ? weight_of(counter.l1i_miss) : 0) + l2_miss;
+        if (this->cache.data) worst += (has_l1d ? weight_of(counter.l1d_miss) : 0) + l2_miss;
+    }, impl.caches);
+    if (!std::holds_alternative <std::monostate> (impl.bp))
+        worst += weight_of(counter.mispredict);
+
+    return worst;
+}
+
 void Device::print_details(bool details) const {
     // if (!details) return;
     allow_unused(details);
     auto &impl = *static_cast <const Impl *> (this);
 
-    const std::size_t arith =
-        impl.counter.add * impl.config.get_weight("add")
-    +   impl.counter.sub * impl.config.get_weight("sub")
-    +   impl.counter.lui * impl.config.get_weight("lui")
-    +   impl.counter.slt * impl.config.get_weight("slt")
-    +   impl.counter.sltu * impl.config.get_weight("sltu")
-    +   impl.counter.auipc * impl.config.get_weight("auipc");
-
-    const std::size_t logic =
-        impl.counter.and_ * impl.config.get_weight("and")
-    +   impl.counter.or_ * impl.config.get_weight("or")
-    +   impl.counter.xor_ * impl.config.get_weight("xor")
-    +   impl.counter.sll * impl.config.get_weight("sll")
-    +   impl.counter.srl * impl.config.get_weight("srl")
-    +   impl.counter.sra * impl.config.get_weight("sra");
-
-    const std::size_t mem =
-        impl.counter.lb * impl.config.get_weight("lb")
-    +   impl.counter.lh * impl.config.get_weight("lh")
-    +   impl.counter.lw * impl.config.get_weight("lw")
-    +   impl.counter.lbu * impl.config.get_weight("lbu")
-    +   impl.counter.lhu * impl.config.get_weight("lhu")
-    +   impl.counter.sb * impl.config.get_weight("sb")
-    +   impl.counter.sh * impl.config.get_weight("sh")
-    +   impl.counter.sw * impl.config.get_weight("sw");
-
-    const std::size_t branch =
-        impl.counter.beq * impl.config.get_weight("beq")
-    +   impl.counter.bne * impl.config.get_weight("bne")
-    +   impl.counter.blt * impl.config.get_weight("blt")
-    +   impl.counter.bge * impl.config.get_weight("bge")
-    +   impl.counter.bltu * impl.config.get_weight("bltu")
-    +   impl.counter.bgeu * impl.config.get_weight("bgeu");
-
-    const std::size_t multiply =
-        impl.counter.mul * impl.config.get_weight("mul")
-    +   impl.counter.mulh * impl.config.get_weight("mulh")
-    +   impl.counter.mulhsu * impl.config.get_weight("mulhsu")
-    +   impl.counter.mulhu * impl.config.get_weight("mulhu");
-
-    const std::size_t divide =
-        impl.counter.div * impl.config.get_weight("div")
-    +   impl.counter.divu * impl.config.get_weight("divu")
-    +   impl.counter.rem * impl.config.get_weight("rem")
-    +   impl.counter.remu * impl.config.get_weight("remu");
-
-    const std::size_t jump = impl.counter.jal * impl.config.get_weight("jal");
-    const std::size_t jalr = impl.counter.jalr * impl.config.get_weight("jalr");
-
-    profile << std::format(
-        "Total cycles: {}\n",
-        arith + logic + mem + branch + jump + jalr + multiply + divide
-    );
+    profile << std::format("Total cycles: {}\n", this->get_cycles());
 
     using namespace config;
 
+    const auto weight_of = [&](const std::size_t &counter) {
+        return get_weight(impl.weights, impl.counter, counter);
+    };
+
     profile << std::format("Instruction parsed: {}\n", impl.counter.iparse);
 
     profile << std::format(
@@ -145,15 +341,45 @@ void Device::print_details(bool details) const {
         impl.counter.jal, impl.counter.jalr
     );
 
-    if (impl.bp.has_value()) {
-        if (auto total = sum_members <CounterBranch> (impl.counter)) {
-            auto failed = impl.bp_failed;
+    std::visit([&]<typename _Tp>(const _Tp &bp) {
+        if constexpr (!std::same_as <_Tp, std::monostate>) {
+            if (auto total = sum_members <CounterBranch> (impl.counter)) {
+                auto failed = impl.counter.mispredict;
+                profile << std::format(
+                    "Branch predictior failures: {:.2f}% ({}/{}), {}, penalty = {} cycles\n",
+                    failed * 100.0 / total, failed, total, bp.describe(),
+                    failed * weight_of(impl.counter.mispredict)
+                );
+            }
+        }
+    }, impl.bp);
+
+    // Some hits are served before the level, and never reach it.
+    const auto print_level = [&](std::string_view name, const auto &level,
+        const std::size_t &misses, std::size_t served) {
+        if constexpr (std::same_as <std::decay_t <decltype(level)>, Cache>) {
+            const auto hits  = level.get_hits() + served;
+            const auto total = hits + level.get_misses();
             profile << std::format(
-                "Branch predictior failures: {:.2f}% ({}/{}) \n",
-                failed * 100.0 / total, failed, total
+                "{} ({}): {:.2f}% hit ({}/{}), miss penalty = {} cycles\n",
+                name, level.describe(), total ? hits * 100.0 / total : 0.0, hits, total,
+                misses * weight_of(misses)
             );
         }
-    }
+    };
+
+    std::visit([&]<typename _Tp>(const _Tp &caches) {
+        // Hits in the fetch buffer and on the last data line belong to the first
+        // level of each. Every command fetched from the buffer is one hit.
+        constexpr bool has_l1i = std::same_as <decltype(_Tp::l1i), Cache>;
+        constexpr bool has_l1d = std::same_as <decltype(_Tp::l1d), Cache>;
+        const auto inst_hits = this->cache.fetched - this->cache.lines;
+        const auto data_hits = this->cache.data_hits;
+        print_level("L1 I-cache", caches.l1i, impl.counter.l1i_miss, has_l1i ? inst_hits : 0);
+        print_level("L1 D-cache", caches.l1d, impl.counter.l1d_miss, has_l1d ? data_hits : 0);
+        print_level("L2 cache",   caches.l2,  impl.counter.l2_miss,
+            (has_l1i ? 0 : inst_hits) + (has_l1d ? 0 : data_hits));
+    }, impl.caches);
 }
 
 } // namespace dark
@@ -6,13 +6,19 @@
 #include <interpreter/memory.h>
 #include <interpreter/register.h>
 #include <interpreter/hint.h>
+#include <interpreter/interval.h>
 #include <simulation/executable.h>
 
 namespace dark {
 
 using _Pair_t = std::pair <Function_t *, Executable::MetaData>;
 
-static auto parse_cmd(command_size_t cmd) -> _Pair_t;
+template <bool _Count>
+static auto parse_cmd(command_size_t cmd, target_size_t pc) -> _Pair_t;
+static auto is_block_terminator(command_size_t cmd) -> bool;
+auto get_counter(command_size_t cmd) -> std::size_t config::Counter::*;
+
+Function_t compile_once;
 
 template <Error error = Error::InsUnknown>
 [[noreturn]]
@@ -33,6 +39,67 @@ static void handle_unknown_instruction(command_size_t cmd) {
  */
 auto Executable::fn(Executable &, RegisterFile &, Memory &, Device &) -> Hint { unreachable(); }
 
+/**
+ * Decode the straight-line run of commands starting from exe,
+ * until a block terminator, an already compiled command,
+ * or the end of the ICache page is met.
+ * Each command in the run records the size of the block starting at it,
+ * so that the interpreter may execute the whole block in one dispatch.
+ * 
+ * Commands after the first one are decoded ahead of time, so they
+ * should never report an error here. Instead, we stop at the
+ * bad command and leave it to be compiled (and reported) later.
+ * 
+ * If batch is set, commands which may be in a block body do not
+ * count by themselves, since counters are updated once per block.
+ * 
+ * @return Number of commands parsed.
+ */
+static auto compile_block(Executable &exe, target_size_t pc, Memory &mem, bool batch) -> std::size_t {
+    constexpr auto kPageMask = target_size_t {Executable::kPageSize - 1};
+    const auto finish = std::min(mem.get_text_range().finish, (pc | kPageMask) + 1);
+
+    const auto parse_cmd = [batch](command_size_t cmd, target_size_t pc) {
+        return batch ? dark::parse_cmd <false> (cmd, pc) : dark::parse_cmd <true> (cmd, pc);
+    };
+
+    const auto cmd = mem.load_cmd(pc);
+    const auto [func, data] = parse_cmd(cmd, pc);
+    exe.set_handle(func, data);
+
+    if (is_block_terminator(cmd)) return 1;
+
+    auto *iter  = &exe + 1;         // The first command after the straight-line run.
+    auto count  = std::size_t {1};  // Number of commands parsed.
+    auto tail   = std::size_t {0};  // Block size of the command at iter.
+
+    for (pc += sizeof(command_size_t) ; pc < finish ; pc += sizeof(command_size_t), ++iter) {
+        if (iter->get_handle() != compile_once) {
+            tail = iter->get_block_size();
+            break;
+        }
+
+        const auto next = mem.load_cmd(pc);
+        try {
+            const auto [next_func, next_data] = parse_cmd(next, pc);
+            iter->set_handle(next_func, next_data);
+        } catch (FailToInterpret &) {
+            break;
+        }
+
+        ++count;
+        if (is_block_terminator(next)) break;
+    }
+
+    // Long runs are split into blocks of at most kMaxBlockSize commands.
+    while (iter-- != &exe) {
+        tail = tail % Executable::kMaxBlockSize + 1;
+        iter->set_block_size(tail);
+    }
+
+    return count;
+}
+
 /**
  * A function which will parse the command at runtime,
  * and reset the executable function pointer.
@@ -43,16 +110,123 @@ auto Executable::fn(Executable &, RegisterFile &, Memory &, Device &) -> Hint {
  */
 auto compile_once(Executable &exe, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     const auto pc = rf.get_pc();
-    dev.counter.iparse += 1;
+    dev.counter.iparse += compile_block(exe, pc, mem, dev.batch);
 
-    const auto cmd = mem.load_cmd(pc);
+    // Run this command alone, even if it starts a block (for threaded dispatch).
+    const auto size = exe.get_block_size();
+    exe.set_block_size(0);
+    const auto hint = exe(rf, mem, dev);
+    exe.set_block_size(size);
 
-    const auto [func, data] = parse_cmd(cmd);
-    exe.set_handle(func, data);
+    // In batch mode, a command in a block body does not count by itself.
+    if (dev.batch && size != 0) ++(dev.counter.*get_counter(mem.load_cmd(pc)));
+
+    return hint;
+}
 
-    return exe(rf, mem, dev);
+/**
+ * Commands which may transfer control, or may report the pc on failure,
+ * should end a block. Division is of the latter kind (divide by zero).
+ */
+static auto is_block_terminator(command_size_t cmd) -> bool {
+    switch (command::get_opcode(cmd)) {
+        case command::b_type::opcode:
+        case command::jal::opcode:
+        case command::jalr::opcode:
+            return true;
+        case command::r_type::opcode: {
+            const auto r_type = command::r_type::from_integer(cmd);
+            return r_type.funct7 == command::r_type::Funct7::DIV
+                && r_type.funct3 >= command::r_type::Funct3::DIV;
+        }
+        default:
+            return false;
+    }
 }
 
+/**
+ * Counter of a command which may be in a block body.
+ * Used when counters are updated in batch, once per block execution.
+ */
+auto get_counter(command_size_t cmd) -> std::size_t config::Counter::* {
+    using Counter = config::Counter;
+    switch (command::get_opcode(cmd)) {
+        case command::lui::opcode:      return &Counter::lui;
+        case command::auipc::opcode:    return &Counter::auipc;
+
+        case command::l_type::opcode:
+            switch (command::l_type::from_integer(cmd).funct3) {
+                case command::l_type::Funct3::LB:   return &Counter::lb;
+                case command::l_type::Funct3::LH:   return &Counter::lh;
+                case command::l_type::Funct3::LW:   return &Counter::lw;
+                case command::l_type::Funct3::LBU:  return &Counter::lbu;
+                case command::l_type::Funct3::LHU:  return &Counter::lhu;
+                default: break;
+            } break;
+
+        case command::s_type::opcode:
+            switch (command::s_type::from_integer(cmd).funct3) {
+                case command::s_type::Funct3::SB:   return &Counter::sb;
+                case command::s_type::Funct3::SH:   return &Counter::sh;
+                case command::s_type::Funct3::SW:   return &Counter::sw;
+                default: break;
+            } break;
+
+        case command::i_type::opcode:
+            switch (command::i_type::from_integer(cmd).funct3) {
+                case command::i_type::Funct3::ADD:  return &Counter::add;
+                case command::i_type::Funct3::SLT:  return &Counter::slt;
+                case command::i_type::Funct3::SLTU: return &Counter::sltu;
+                case command::i_type::Funct3::XOR:  return &Counter::xor_;
+                case command::i_type::Funct3::OR:   return &Counter::or_;
+                case command::i_type::Funct3::AND:  return &Counter::and_;
+                case command::i_type::Funct3::SLL:  return &Counter::sll;
+                case command::i_type::Funct3::SRL:
+                    if (command::get_funct7(cmd) == command::i_type::Funct7::SRA)
+                        return &Counter::sra;
+                    return &Counter::srl;
+                default: break;
+            } break;
+
+        case command::r_type::opcode: {
+            constexpr auto join = // A simple function to join two integers.
+                [](std::uint32_t a, std::uint32_t b) -> std::uint32_t {
+                    return (a << 3) | b;
+                };
+
+            #define match_and_return(a, name) \
+                case join(command::r_type::Funct7::a, command::r_type::Funct3::a): \
+                    return &Counter::name
+
+            const auto r_type = command::r_type::from_integer(cmd);
+            switch (join(r_type.funct7, r_type.funct3)) {
+                match_and_return(ADD, add);
+                match_and_return(SUB, sub);
+                match_and_return(SLL, sll);
+                match_and_return(SLT, slt);
+                match_and_return(SLTU, sltu);
+                match_and_return(XOR, xor_);
+                match_and_return(SRL, srl);
+                match_and_return(SRA, sra);
+                match_and_return(OR, or_);
+                match_and_return(AND, and_);
+                match_and_return(MUL, mul);
+                match_and_return(MULH, mulh);
+                match_and_return(MULHSU, mulhsu);
+                match_and_return(MULHU, mulhu);
+                default: break;
+            }
+
+            #undef match_and_return
+        } break;
+
+        default: break;
+    }
+
+    unreachable("Not a command in block body");
+}
+
+template <bool _Count>
 static auto parse_r_type(command_size_t cmd) -> _Pair_t {
     auto r_type = command::r_type::from_integer(cmd);
 
@@ -68,30 +242,35 @@ static auto parse_r_type(command_size_t cmd) -> _Pair_t {
         .rd = rd, .rs1 = rs1, .rs2 = rs2,
     };
 
-    #define match_and_return(a) \
+    const bool discard = (rd == Register::zero);
+
+    #define match_and_return(a, count) \
         case join(command::r_type::Funct7::a, command::r_type::Funct3::a):  \
-            return { interpreter::ArithReg::fn <general::ArithOp::a>, arg }
+            return { discard \
+                ? interpreter::ArithReg::fn <general::ArithOp::a, true, count> \
+                : interpreter::ArithReg::fn <general::ArithOp::a, false, count>, arg }
 
     switch (join(r_type.funct7, r_type.funct3)) {
-        match_and_return(ADD);
-        match_and_return(SUB);
-        match_and_return(SLL);
-        match_and_return(SLT);
-        match_and_return(SLTU);
-        match_and_return(XOR);
-        match_and_return(SRL);
-        match_and_return(SRA);
-        match_and_return(OR);
-        match_and_return(AND);
-
-        match_and_return(MUL);
-        match_and_return(MULH);
-        match_and_return(MULHSU);
-        match_and_return(MULHU);
-        match_and_return(DIV);
-        match_and_return(DIVU);
-        match_and_return(REM);
-        match_and_return(REMU);
+        match_and_return(ADD, _Count);
+        match_and_return(SUB, _Count);
+        match_and_return(SLL, _Count);
+        match_and_return(SLT, _Count);
+        match_and_return(SLTU, _Count);
+        match_and_return(XOR, _Count);
+        match_and_return(SRL, _Count);
+        match_and_return(SRA, _Count);
+        match_and_return(OR, _Count);
+        match_and_return(AND, _Count);
+
+        match_and_return(MUL, _Count);
+        match_and_return(MULH, _Count);
+        match_and_return(MULHSU, _Count);
+        match_and_return(MULHU, _Count);
+        // Division ends a block, so it always counts by itself.
+        match_and_return(DIV, true);
+        match_and_return(DIVU, true);
+        match_and_return(REM, true);
+        match_and_return(REMU, true);
 
         default: break;
     }
@@ -100,6 +279,7 @@ static auto parse_r_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
+template <bool _Count>
 static auto parse_i_type(command_size_t cmd) -> _Pair_t {
     auto i_type = command::i_type::from_integer(cmd);
     auto rs1 = int_to_reg(i_type.rs1);
@@ -108,12 +288,23 @@ static auto parse_i_type(command_size_t cmd) -> _Pair_t {
         .rd = rd, .rs1 = rs1, .imm = i_type.get_imm()
     };
 
+    const bool discard = (rd == Register::zero);
+
+    #define make_result(a) \
+        _Pair_t { discard \
+            ? interpreter::ArithImm::fn <general::ArithOp::a, true, _Count> \
+            : interpreter::ArithImm::fn <general::ArithOp::a, false, _Count>, arg }
+
     #define match_and_return(a) \
-        case command::i_type::Funct3::a: \
-            return { interpreter::ArithImm::fn <general::ArithOp::a>, arg }
+        case command::i_type::Funct3::a: return make_result(a)
 
     switch (i_type.funct3) {
-        match_and_return(ADD);
+        case command::i_type::Funct3::ADD:
+            if (discard)                return make_result(ADD);
+            if (rs1 == Register::zero)  return { interpreter::Li::fn <_Count>, arg };
+            if (arg.imm == 0)           return { interpreter::Mv::fn <_Count>, arg };
+            return make_result(ADD);
+
         match_and_return(SLT);
         match_and_return(SLTU);
         match_and_return(XOR);
@@ -122,23 +313,25 @@ static auto parse_i_type(command_size_t cmd) -> _Pair_t {
 
         case command::i_type::Funct3::SLL:
             if (command::get_funct7(cmd) != command::i_type::Funct7::SLL) break;
-            return { interpreter::ArithImm::fn <general::ArithOp::SLL>, arg };
+            return make_result(SLL);
 
         case command::i_type::Funct3::SRL:
             if (command::get_funct7(cmd) == command::i_type::Funct7::SRL)
-                return { interpreter::ArithImm::fn <general::ArithOp::SRL>, arg };
+                return make_result(SRL);
             if (command::get_funct7(cmd) == command::i_type::Funct7::SRA)
-                return { interpreter::ArithImm::fn <general::ArithOp::SRA>, arg };
+                return make_result(SRA);
             break; // Invalid shift operation.
 
         default: break;
     }
 
     #undef match_and_return
+    #undef make_result
 
     handle_unknown_instruction(cmd);
 }
 
+template <bool _Count>
 static auto parse_s_type(command_size_t cmd) -> _Pair_t {
     auto s_type = command::s_type::from_integer(cmd);
     auto rs1 = int_to_reg(s_type.rs1);
@@ -149,7 +342,7 @@ static auto parse_s_type(command_size_t cmd) -> _Pair_t {
 
     #define match_and_return(a) \
         case command::s_type::Funct3::a: \
-            return { interpreter::LoadStore::fn <general::MemoryOp::a>, arg }
+            return { interpreter::LoadStore::fn <general::MemoryOp::a, false, _Count>, arg }
 
     switch (s_type.funct3) {
         match_and_return(SB);
@@ -162,6 +355,7 @@ static auto parse_s_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
+template <bool _Count>
 static auto parse_l_type(command_size_t cmd) -> _Pair_t {
     auto l_type = command::l_type::from_integer(cmd);
     auto rs1 = int_to_reg(l_type.rs1);
@@ -170,9 +364,13 @@ static auto parse_l_type(command_size_t cmd) -> _Pair_t {
         .rd = rd, .rs1 = rs1, .imm = l_type.get_imm()
     };
 
+    const bool discard = (rd == Register::zero);
+
     #define match_and_return(a) \
         case command::l_type::Funct3::a: \
-            return { interpreter::LoadStore::fn <general::MemoryOp::a>, arg }
+            return { discard \
+                ? interpreter::LoadStore::fn <general::MemoryOp::a, true, _Count> \
+                : interpreter::LoadStore::fn <general::MemoryOp::a, false, _Count>, arg }
 
     switch (l_type.funct3) {
         match_and_return(LB);
@@ -187,7 +385,25 @@ static auto parse_l_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
-static auto parse_b_type(command_size_t cmd) -> _Pair_t {
+/**
+ * Whether the command at pc + offset lies in the same ICache page as pc.
+ * If so, the successor can be chained to directly without any check,
+ * since the whole page is allocated together.
+ */
+static auto is_in_page(target_size_t pc, target_size_t offset) -> bool {
+    static_assert(kTextStart % Executable::kPageSize == 0);
+    return offset % sizeof(command_size_t) == 0
+        && ((pc + offset) ^ pc) < Executable::kPageSize;
+}
+
+template <general::BranchOp op>
+static auto select_branch(bool zero, bool chain) -> Function_t * {
+    using interpreter::Branch::fn;
+    if (zero)   return chain ? fn <op, true, true>  : fn <op, true, false>;
+    else        return chain ? fn <op, false, true> : fn <op, false, false>;
+}
+
+static auto parse_b_type(command_size_t cmd, target_size_t pc) -> _Pair_t {
     auto b_type = command::b_type::from_integer(cmd);
     auto rs1 = int_to_reg(b_type.rs1);
     auto rs2 = int_to_reg(b_type.rs2);
@@ -195,9 +411,14 @@ static auto parse_b_type(command_size_t cmd) -> _Pair_t {
         .rs1 = rs1, .rs2 = rs2, .imm = b_type.get_imm()
     };
 
+    // beqz, bnez, bltz, bgez ... compare with zero.
+    const bool zero = (rs2 == Register::zero);
+    // Both successors are in this page, so they can be chained directly.
+    const bool chain = is_in_page(pc, arg.imm) && is_in_page(pc, sizeof(command_size_t));
+
     #define match_and_return(a) \
         case command::b_type::Funct3::a: \
-            return { interpreter::Branch::fn <general::BranchOp::a>, arg }
+            return { select_branch <general::BranchOp::a> (zero, chain), arg }
 
     switch (b_type.funct3) {
         match_and_return(BEQ);
@@ -213,16 +434,21 @@ static auto parse_b_type(command_size_t cmd) -> _Pair_t {
     handle_unknown_instruction(cmd);
 }
 
-static auto parse_auipc(command_size_t cmd) -> _Pair_t {
+// The pc is known at compile time, so it is folded into the immediate.
+template <bool _Count>
+static auto parse_auipc(command_size_t cmd, target_size_t pc) -> _Pair_t {
     auto auipc = command::auipc::from_integer(cmd);
     auto rd  = int_to_reg(auipc.rd);
     auto arg = Executable::MetaData {
-        .rd = rd, .imm = auipc.get_imm()
+        .rd = rd, .imm = pc + auipc.get_imm()
     };
 
-    return { interpreter::Auipc::fn, arg };
+    if (rd == Register::zero)
+        return { interpreter::Auipc::fn <true, _Count>, arg };
+    return { interpreter::Auipc::fn <false, _Count>, arg };
 }
 
+template <bool _Count>
 static auto parse_lui(command_size_t cmd) -> _Pair_t {
     auto lui = command::lui::from_integer(cmd);
     auto rd  = int_to_reg(lui.rd);
@@ -230,20 +456,34 @@ static auto parse_lui(command_size_t cmd) -> _Pair_t {
         .rd = rd, .imm = lui.get_imm()
     };
 
-    return { interpreter::Lui::fn, arg };
+    if (rd == Register::zero)
+        return { interpreter::Lui::fn <true, _Count>, arg };
+    return { interpreter::Lui::fn <false, _Count>, arg };
 }
 
-static auto parse_jal(command_size_t cmd) -> _Pair_t {
+static auto parse_jal(command_size_t cmd, target_size_t pc) -> _Pair_t {
     auto jal = command::jal::from_integer(cmd);
     auto rd  = int_to_reg(jal.rd);
     auto arg = Executable::MetaData {
         .rd = rd, .imm = jal.get_imm()
     };
 
-    return { interpreter::Jump::fn, arg };
+    using interpreter::Jump::fn;
+
+    const bool chain = is_in_page(pc, arg.imm);
+    // The return site is only cached if it is in the same page.
+    const bool cache = is_in_page(pc, sizeof(command_size_t));
+
+    if (rd == Register::zero)
+        return { chain ? fn <true, true> : fn <true>, arg };
+    if (rd == Register::ra && cache)
+        return { chain ? fn <false, true, true> : fn <false, false, true>, arg };
+    if (rd == Register::ra)
+        return { chain ? fn <false, true, true, false> : fn <false, false, true, false>, arg };
+    return { chain ? fn <false, true> : fn <false>, arg };
 }
 
-static auto parse_jalr(command_size_t cmd) -> _Pair_t {
+static auto parse_jalr(command_size_t cmd, target_size_t pc) -> _Pair_t {
     auto jalr = command::jalr::from_integer(cmd);
     auto rs1 = int_to_reg(jalr.rs1);
     auto rd  = int_to_reg(jalr.rd);
@@ -251,29 +491,38 @@ static auto parse_jalr(command_size_t cmd) -> _Pair_t {
         .rd = rd, .rs1 = rs1, .imm = jalr.get_imm()
     };
 
-    return { interpreter::Jalr::fn, arg };
+    using interpreter::Jalr::fn;
+
+    if (rd == Register::zero) // ret
+        return { rs1 == Register::ra ? fn <true, false, true> : fn <true>, arg };
+    if (rd == Register::ra && is_in_page(pc, sizeof(command_size_t)))
+        return { fn <false, true>, arg };
+    if (rd == Register::ra) // The return site is in the next page.
+        return { fn <false, true, false, false>, arg };
+    return { fn <>, arg };
 }
 
-auto parse_cmd(command_size_t cmd) -> _Pair_t {
+template <bool _Count>
+auto parse_cmd(command_size_t cmd, target_size_t pc) -> _Pair_t {
     switch (command::get_opcode(cmd)) {
         case command::r_type::opcode:
-            return parse_r_type(cmd);
+            return parse_r_type <_Count> (cmd);
         case command::i_type::opcode:
-            return parse_i_type(cmd);
+            return parse_i_type <_Count> (cmd);
         case command::s_type::opcode:
-            return parse_s_type(cmd);
+            return parse_s_type <_Count> (cmd);
         case command::l_type::opcode:
-            return parse_l_type(cmd);
+            return parse_l_type <_Count> (cmd);
         case command::b_type::opcode:
-            return parse_b_type(cmd);
+            return parse_b_type(cmd, pc);
         case command::auipc::opcode:
-            return parse_auipc(cmd);
+            return parse_auipc <_Count> (cmd, pc);
         case command::lui::opcode:
-            return parse_lui(cmd);
+            return parse_lui <_Count> (cmd);
         case command::jal::opcode:
-            return parse_jal(cmd);
+            return parse_jal(cmd, pc);
         case command::jalr::opcode:
-            return parse_jalr(cmd);
+            return parse_jalr(cmd, pc);
 
         default: break;
     }
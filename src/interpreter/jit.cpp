@@ -0,0 +1,537 @@
+#include <utility.h>
+#include <general.h>
+#include <riscv/abi.h>
+#include <riscv/command.h>
+#include <interpreter/jit.h>
+#include <interpreter/device.h>
+#include <interpreter/memory.h>
+#include <interpreter/register.h>
+#include <interpreter/interval.h>
+#include <interpreter/executable.h>
+#include <config/config.h>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace dark {
+
+#if defined(__x86_64__) && defined(__linux__)
+static constexpr bool kJitSupported = true;
+#else
+static constexpr bool kJitSupported = false;
+#endif
+
+/**
+ * Native code of a block. Registers are passed by their base address,
+ * and the rest are only used for counters and call-outs.
+ * @return False if some call-out throws (see call_out below).
+ */
+using _Native_t = bool(target_size_t *, RegisterFile *, Memory *, Device *);
+
+// A block becomes hot after so many executions.
+static constexpr std::uint32_t kHotThreshold = 64;
+// Size of the executable arena. The JIT stops compiling when it is full.
+static constexpr std::size_t kArenaSize = 16 * 1024 * 1024;
+
+struct Jit_Impl {
+    struct Entry {
+        std::uint32_t heat;
+        _Native_t *code;
+    };
+
+    std::vector <Entry> entries;    // One for each command in the text.
+    std::deque <Executable> stubs;  // Copies of commands to call back.
+    std::span <std::byte> arena;    // mmap'd executable memory.
+    std::size_t used;               // Bytes used in the arena.
+    std::size_t compiled;           // Number of blocks compiled.
+    bool exhausted;                 // Whether the arena is full.
+
+    auto compile(Executable &, std::size_t, target_size_t, Memory &, Device &) -> _Native_t *;
+    auto install(std::span <const std::uint8_t>) -> _Native_t *;
+};
+
+struct Jit::Impl : Jit, Jit_Impl {
+    explicit Impl(std::size_t length, std::span <std::byte> arena)
+        : Jit {}, Jit_Impl {
+            .entries = std::vector <Entry> (length),
+            .stubs = {},
+            .arena = arena,
+            .used = {},
+            .compiled = {},
+            .exhausted = {},
+        } {}
+};
+
+auto Jit::get_impl() -> Impl & {
+    return *static_cast <Impl *> (this);
+}
+
+// This function is implemented in interpreter/executable.cpp
+auto get_counter(command_size_t) -> std::size_t config::Counter::*;
+
+/* Exception thrown in the last call-out, rethrown after the native code returns. */
+static std::exception_ptr pending;
+
+/**
+ * Native code has no unwind information, so exceptions must not
+ * pass through it. The call-out catches them and reports failure.
+ */
+static auto call_out(Executable *exe, RegisterFile *rf, Memory *mem, Device *dev) noexcept -> bool {
+    try {
+        (*exe)(*rf, *mem, *dev);
+        return true;
+    } catch (...) {
+        pending = std::current_exception();
+        return false;
+    }
+}
+
+/**
+ * A minimal x86-64 encoder, which only covers what the JIT needs.
+ * Register usage in the native code:
+ * - rbx: base of guest registers
+ * - r12, r13, r14: RegisterFile, Memory, Device
+ * - eax, ecx, edx: scratch
+ */
+struct X86Emitter {
+  public:
+    enum Reg : std::uint8_t { EAX = 0, ECX = 1, EDX = 2 };
+
+    std::vector <std::uint8_t> code;
+
+    // If set, counters are summed up and added once at the block end.
+    std::optional <std::map <std::int32_t, std::uint32_t>> batch;
+
+    void emit(std::initializer_list <std::uint8_t> bytes) {
+        this->code.insert(this->code.end(), bytes);
+    }
+
+    template <typename _Int>
+    void emit_value(_Int value) {
+        std::uint8_t bytes[sizeof(_Int)];
+        std::memcpy(bytes, &value, sizeof(_Int));
+        this->code.insert(this->code.end(), std::begin(bytes), std::end(bytes));
+    }
+
+    /* mov r32, [rbx + reg] */
+    void load(Reg dst, RegisterOffset reg) {
+        this->emit({ 0x8B, std::uint8_t(0x43 | dst << 3), reg.value });
+    }
+
+    /* mov [rbx + reg], eax */
+    void store(RegisterOffset reg) {
+        this->emit({ 0x89, 0x43, reg.value });
+    }
+
+    /* mov dword [rbx + reg], imm32 */
+    void store_imm(RegisterOffset reg, std::uint32_t imm) {
+        this->emit({ 0xC7, 0x43, reg.value });
+        this->emit_value(imm);
+    }
+
+    /* <op> eax, [rbx + reg] */
+    void alu_mem(std::uint8_t op, RegisterOffset reg) {
+        this->emit({ op, 0x43, reg.value });
+    }
+
+    /* <op> eax, imm32 (the short form for eax) */
+    void alu_imm(std::uint8_t op, std::uint32_t imm) {
+        this->emit({ op });
+        this->emit_value(imm);
+    }
+
+    /* inc qword [r14 + disp32], or defer it in batch mode */
+    void count(std::int32_t disp) {
+        if (this->batch.has_value()) {
+            (*this->batch)[disp] += 1;
+        } else {
+            this->emit({ 0x49, 0xFF, 0x86 });
+            this->emit_value(disp);
+        }
+    }
+
+    /* add qword [r14 + disp32], imm32 for each deferred counter */
+    void flush() {
+        if (!this->batch.has_value()) return;
+        for (const auto &[disp, times] : *this->batch) {
+            this->emit({ 0x49, 0x81, 0x86 });
+            this->emit_value(disp);
+            this->emit_value(times);
+        }
+        this->batch->clear();
+    }
+
+    void prologue() {
+        // 5 pushes, so that rsp is 16-byte aligned for call-outs.
+        this->emit({ 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56 });
+        this->emit({ 0x48, 0x89, 0xFB });   // mov rbx, rdi
+        this->emit({ 0x49, 0x89, 0xF4 });   // mov r12, rsi
+        this->emit({ 0x49, 0x89, 0xD5 });   // mov r13, rdx
+        this->emit({ 0x49, 0x89, 0xCE });   // mov r14, rcx
+    }
+
+    void epilogue(bool result) {
+        if (result)
+            this->emit({ 0xB8, 0x01, 0x00, 0x00, 0x00 }); // mov eax, 1
+        else
+            this->emit({ 0x31, 0xC0 }); // xor eax, eax
+        this->emit({ 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3 });
+    }
+
+    /**
+     * Call back to the handler of exe, and jump to the failure exit
+     * if it throws. Return the position of the jump offset to patch.
+     */
+    auto call(Executable &exe) -> std::size_t {
+        this->emit({ 0x48, 0xBF });                 // mov rdi, imm64
+        this->emit_value(reinterpret_cast <std::uintptr_t> (&exe));
+        this->emit({ 0x4C, 0x89, 0xE6 });           // mov rsi, r12
+        this->emit({ 0x4C, 0x89, 0xEA });           // mov rdx, r13
+        this->emit({ 0x4C, 0x89, 0xF1 });           // mov rcx, r14
+        this->emit({ 0x48, 0xB8 });                 // mov rax, imm64
+        this->emit_value(reinterpret_cast <std::uintptr_t> (&call_out));
+        this->emit({ 0xFF, 0xD0 });                 // call rax
+        this->emit({ 0x84, 0xC0 });                 // test al, al
+        this->emit({ 0x0F, 0x84 });                 // jz rel32
+        this->emit_value(std::int32_t {});
+        return this->code.size() - sizeof(std::int32_t);
+    }
+
+    /* Patch a rel32 jump at pos to the current position. */
+    void patch(std::size_t pos) {
+        const auto rel = std::int32_t(this->code.size() - (pos + sizeof(std::int32_t)));
+        std::memcpy(this->code.data() + pos, &rel, sizeof(rel));
+    }
+};
+
+static auto decode_r_type(command_size_t cmd) -> std::optional <general::ArithOp> {
+    auto r_type = command::r_type::from_integer(cmd);
+
+    constexpr auto join = // A simple function to join two integers.
+        [](std::uint32_t a, std::uint32_t b) -> std::uint32_t {
+            return (a << 3) | b;
+        };
+
+    #define match_and_return(a) \
+        case join(command::r_type::Funct7::a, command::r_type::Funct3::a): \
+            return general::ArithOp::a
+
+    // Division is never in a block body, since it may report the pc.
+    switch (join(r_type.funct7, r_type.funct3)) {
+        match_and_return(ADD);
+        match_and_return(SUB);
+        match_and_return(SLL);
+        match_and_return(SLT);
+        match_and_return(SLTU);
+        match_and_return(XOR);
+        match_and_return(SRL);
+        match_and_return(SRA);
+        match_and_return(OR);
+        match_and_return(AND);
+        match_and_return(MUL);
+        match_and_return(MULH);
+        match_and_return(MULHSU);
+        match_and_return(MULHU);
+        default: return std::nullopt;
+    }
+
+    #undef match_and_return
+}
+
+static auto decode_i_type(command_size_t cmd) -> std::optional <general::ArithOp> {
+    auto i_type = command::i_type::from_integer(cmd);
+    const auto funct7 = command::get_funct7(cmd);
+
+    using enum general::ArithOp;
+    switch (i_type.funct3) {
+        case command::i_type::Funct3::ADD:  return ADD;
+        case command::i_type::Funct3::SLT:  return SLT;
+        case command::i_type::Funct3::SLTU: return SLTU;
+        case command::i_type::Funct3::XOR:  return XOR;
+        case command::i_type::Funct3::OR:   return OR;
+        case command::i_type::Funct3::AND:  return AND;
+        case command::i_type::Funct3::SLL:
+            if (funct7 == command::i_type::Funct7::SLL) return SLL;
+            return std::nullopt;
+        case command::i_type::Funct3::SRL:
+            if (funct7 == command::i_type::Funct7::SRL) return SRL;
+            if (funct7 == command::i_type::Funct7::SRA) return SRA;
+            return std::nullopt;
+        default: return std::nullopt;
+    }
+}
+
+static auto get_counter(general::ArithOp op, Device &dev) -> std::size_t & {
+    using enum general::ArithOp;
+    switch (op) {
+        case ADD:       return dev.counter.add;
+        case SUB:       return dev.counter.sub;
+        case AND:       return dev.counter.and_;
+        case OR:        return dev.counter.or_;
+        case XOR:       return dev.counter.xor_;
+        case SLL:       return dev.counter.sll;
+        case SRL:       return dev.counter.srl;
+        case SRA:       return dev.counter.sra;
+        case SLT:       return dev.counter.slt;
+        case SLTU:      return dev.counter.sltu;
+        case MUL:       return dev.counter.mul;
+        case MULH:      return dev.counter.mulh;
+        case MULHSU:    return dev.counter.mulhsu;
+        case MULHU:     return dev.counter.mulhu;
+        default:        unreachable();
+    }
+}
+
+/* Displacement of a counter from the device, which is held in r14. */
+static auto get_disp(const std::size_t &counter, const Device &dev) -> std::int32_t {
+    const auto *base = reinterpret_cast <const std::byte *> (&dev);
+    const auto *what = reinterpret_cast <const std::byte *> (&counter);
+    return static_cast <std::int32_t> (what - base);
+}
+
+/**
+ * Emit an arithmetic command, with either rs2 or imm as the second operand.
+ * @return Whether the command is supported.
+ */
+static auto emit_arith(X86Emitter &as, general::ArithOp op, bool is_imm,
+    const Executable::MetaData &meta, Device &dev) -> bool {
+    using enum general::ArithOp;
+    using enum X86Emitter::Reg;
+
+    const auto imm = meta.imm;
+
+    // Opcodes of "<op> eax, [mem]" and "<op> eax, imm32".
+    const auto alu = [&](std::uint8_t mem_op, std::uint8_t imm_op) {
+        is_imm ? as.alu_imm(imm_op, imm) : as.alu_mem(mem_op, meta.rs2);
+    };
+    // ModR/M of "shl/shr/sar eax".
+    const auto shift = [&](std::uint8_t modrm) {
+        if (is_imm) {
+            as.emit({ 0xC1, modrm, std::uint8_t(imm % 32) });
+        } else {
+            as.load(ECX, meta.rs2);
+            as.emit({ 0xD3, modrm });
+        }
+    };
+    // Opcode of "setcc al".
+    const auto compare = [&](std::uint8_t setcc) {
+        alu(0x3B, 0x3D);
+        as.emit({ 0x0F, setcc, 0xC0 });         // setcc al
+        as.emit({ 0x0F, 0xB6, 0xC0 });          // movzx eax, al
+    };
+
+    switch (op) {
+        case ADD:   as.load(EAX, meta.rs1); alu(0x03, 0x05); break;
+        case SUB:   as.load(EAX, meta.rs1); alu(0x2B, 0x2D); break;
+        case AND:   as.load(EAX, meta.rs1); alu(0x23, 0x25); break;
+        case OR:    as.load(EAX, meta.rs1); alu(0x0B, 0x0D); break;
+        case XOR:   as.load(EAX, meta.rs1); alu(0x33, 0x35); break;
+        case SLL:   as.load(EAX, meta.rs1); shift(0xE0); break;
+        case SRL:   as.load(EAX, meta.rs1); shift(0xE8); break;
+        case SRA:   as.load(EAX, meta.rs1); shift(0xF8); break;
+        case SLT:   as.load(EAX, meta.rs1); compare(0x9C); break;
+        case SLTU:  as.load(EAX, meta.rs1); compare(0x92); break;
+        case MUL:
+            as.load(EAX, meta.rs1);
+            as.emit({ 0x0F, 0xAF, 0x43, meta.rs2.value });  // imul eax, [rbx + rs2]
+            break;
+        case MULH:
+            as.load(EAX, meta.rs1);
+            as.emit({ 0xF7, 0x6B, meta.rs2.value });        // imul dword [rbx + rs2]
+            as.emit({ 0x89, 0xD0 });                        // mov eax, edx
+            break;
+        case MULHU:
+            as.load(EAX, meta.rs1);
+            as.emit({ 0xF7, 0x63, meta.rs2.value });        // mul dword [rbx + rs2]
+            as.emit({ 0x89, 0xD0 });                        // mov eax, edx
+            break;
+        case MULHSU:
+            as.emit({ 0x48, 0x63, 0x43, meta.rs1.value });  // movsxd rax, [rbx + rs1]
+            as.load(ECX, meta.rs2);
+            as.emit({ 0x48, 0x0F, 0xAF, 0xC1 });            // imul rax, rcx
+            as.emit({ 0x48, 0xC1, 0xE8, 0x20 });            // shr rax, 32
+            break;
+        default: return false;
+    }
+
+    // The zero register is never written.
+    if (meta.rd.value != 0) as.store(meta.rd);
+    as.count(get_disp(get_counter(op, dev), dev));
+    return true;
+}
+
+/**
+ * Translate one command of a block body.
+ * @return Whether the command is supported, otherwise nothing is emitted.
+ */
+static auto translate(X86Emitter &as, command_size_t cmd,
+    const Executable::MetaData &meta, Device &dev) -> bool {
+    switch (command::get_opcode(cmd)) {
+        case command::r_type::opcode:
+            if (auto op = decode_r_type(cmd))
+                return emit_arith(as, *op, false, meta, dev);
+            return false;
+        case command::i_type::opcode:
+            if (auto op = decode_i_type(cmd))
+                return emit_arith(as, *op, true, meta, dev);
+            return false;
+        case command::lui::opcode:
+            if (meta.rd.value != 0) as.store_imm(meta.rd, meta.imm);
+            as.count(get_disp(dev.counter.lui, dev));
+            return true;
+        case command::auipc::opcode: // pc is folded into imm at compile time
+            if (meta.rd.value != 0) as.store_imm(meta.rd, meta.imm);
+            as.count(get_disp(dev.counter.auipc, dev));
+            return true;
+        default:
+            return false;
+    }
+}
+
+auto Jit_Impl::compile(Executable &exe, std::size_t size,
+    target_size_t pc, Memory &mem, Device &dev) -> _Native_t * {
+    X86Emitter as;
+    std::vector <std::size_t> patches;
+
+    // In batch mode, call-outs do not count by themselves either.
+    if (dev.batch) as.batch.emplace();
+
+    as.prologue();
+
+    // Commands are decoded already, so the command words are only
+    // read to know the operation. Operands come from the metadata.
+    for (std::size_t i = 0 ; i < size ; ++i) {
+        auto &body = (&exe)[i];
+        const auto cmd = mem.load_cmd(pc + i * sizeof(command_size_t));
+        if (translate(as, cmd, body.get_meta(), dev)) continue;
+
+        // Call back to a copy of the command, which is not chained
+        // to the rest of the block (for threaded dispatch).
+        auto meta = body.get_meta();
+        meta.block = 0;
+        auto &stub = this->stubs.emplace_back(body.get_handle(), meta);
+        patches.push_back(as.call(stub));
+        if (dev.batch) as.count(get_disp(dev.counter.*get_counter(cmd), dev));
+    }
+
+    as.flush();
+    as.epilogue(true);
+    for (const auto pos : patches) as.patch(pos);
+    as.epilogue(false);
+
+    return this->install(as.code);
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+
+// The arena starts writable, and pages become executable once filled.
+static auto map_arena() -> std::span <std::byte> {
+    auto *ptr = ::mmap(nullptr, kArenaSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) return {};
+    return { static_cast <std::byte *> (ptr), kArenaSize };
+}
+
+// Make the pages covering some part of the arena either writable or executable.
+static auto protect_arena(std::span <std::byte> part, bool exec) -> bool {
+    static const auto kPageSize = static_cast <std::uintptr_t> (::sysconf(_SC_PAGESIZE));
+    const auto first = reinterpret_cast <std::uintptr_t> (part.data()) & ~(kPageSize - 1);
+    const auto last  = reinterpret_cast <std::uintptr_t> (part.data() + part.size());
+    const auto prot  = exec ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE;
+    return ::mprotect(reinterpret_cast <void *> (first), last - first, prot) == 0;
+}
+
+static void unmap_arena(std::span <std::byte> arena) {
+    if (!arena.empty()) ::munmap(arena.data(), arena.size());
+}
+
+#else
+
+static auto map_arena() -> std::span <std::byte> { return {}; }
+static auto protect_arena(std::span <std::byte>, bool) -> bool { return false; }
+static void unmap_arena(std::span <std::byte>) {}
+
+#endif
+
+/* Copy the code into the arena. Return null if the arena is full or protection fails. */
+auto Jit_Impl::install(std::span <const std::uint8_t> code) -> _Native_t * {
+    constexpr std::size_t kAlign = 16;
+    const auto start = (this->used + kAlign - 1) / kAlign * kAlign;
+    if (start + code.size() > this->arena.size()) {
+        this->exhausted = true;
+        return nullptr;
+    }
+
+    // Pages are never writable and executable at once (W^X).
+    // Once made writable, the page may hold older code, so it must come back.
+    const auto part = this->arena.subspan(start, code.size());
+    if (!protect_arena(part, false)) {
+        this->exhausted = true;
+        return nullptr;
+    }
+    std::memcpy(part.data(), code.data(), code.size());
+    panic_if(!protect_arena(part, true), "Failed to protect JIT code");
+
+    this->used = start + code.size();
+    this->compiled += 1;
+    return reinterpret_cast <_Native_t *> (part.data());
+}
+
+auto Jit::create(const Config &config, Memory &mem) -> std::unique_ptr <Jit> {
+    if (!config.has_option("jit")) return nullptr;
+
+    if (!kJitSupported) {
+        warning("JIT is only supported on x86-64 Linux, fall back to interpreter.");
+        return nullptr;
+    }
+
+    auto arena = map_arena();
+    if (arena.empty()) {
+        warning("Failed to map executable memory for JIT, fall back to interpreter.");
+        return nullptr;
+    }
+
+    const auto length = (mem.get_text_range().finish - kTextStart) / sizeof(command_size_t);
+    return std::unique_ptr <Jit> (new Jit::Impl { length, arena });
+}
+
+bool Jit::execute(Executable &exe, std::size_t size, RegisterFile &rf, Memory &mem, Device &dev) {
+    auto &impl  = this->get_impl();
+    const auto pc = rf.get_pc();
+    auto &entry = impl.entries[(pc - kTextStart) / sizeof(command_size_t)];
+
+    if (entry.code == nullptr) {
+        if (impl.exhausted || ++entry.heat < kHotThreshold) return false;
+        entry.code = impl.compile(exe, size, pc, mem, dev);
+        if (entry.code == nullptr) return false;
+    }
+
+    if (!entry.code(&rf[RegisterOffset {}], &rf, &mem, &dev))
+        std::rethrow_exception(std::exchange(pending, nullptr));
+
+    return true;
+}
+
+Jit::~Jit() {
+    auto &impl = this->get_impl();
+    unmap_arena(impl.arena);
+    std::destroy_at <Jit_Impl> (&impl);
+}
+
+void Jit::print_details(bool) const {
+    auto &impl = *static_cast <const Impl *> (this);
+    console::profile << std::format(
+        "JIT blocks compiled: {} ({} bytes)\n", impl.compiled, impl.used);
+}
+
+} // namespace dark
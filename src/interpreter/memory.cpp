@@ -1,4 +1,5 @@
 #include <interpreter/memory.h>
+#include <interpreter/device.h>
 #include <interpreter/exception.h>
 #include <interpreter/executable.h>
 #include <simulation/area.h>
@@ -25,10 +26,24 @@ static auto int_cast(std::byte *ptr) -> _Int & {
  * - Libc text
  * - Text
  * - Data | RoData | Bss | Heap
+ *
+ * With a flat space, all areas share one host mapping,
+ * so data and heap (and the gap between) form one range.
  */
-struct Memory_Impl : StaticArea, HeapArea, StackArea {
-    explicit Memory_Impl(const Config &config, const MemoryLayout &layout)
-        : StaticArea(layout), HeapArea(layout), StackArea(config) {}
+struct Memory_Impl : FlatSpace, StaticArea, HeapArea, StackArea {
+    RegionCache &cache; // Shared with the inline fast path in Memory.
+
+    explicit Memory_Impl(const Config &config, const MemoryLayout &layout, RegionCache &cache)
+        : FlatSpace(config), StaticArea(layout, *this),
+          HeapArea(layout, *this), StackArea(config, *this), cache(cache) {}
+
+    /* Return the host address of [addr, addr + size), or null if out of bound. */
+    auto lookup(target_size_t addr, std::size_t size) -> std::byte * {
+        if (auto *ptr = this->cache.find(addr, size)) return ptr;
+        return this->refill(addr, size);
+    }
+
+    auto refill(target_size_t, std::size_t) -> std::byte *;
 
     auto checked_ifetch(target_size_t) -> command_size_t;
 
@@ -43,7 +58,7 @@ struct Memory_Impl : StaticArea, HeapArea, StackArea {
 
 struct Memory::Impl : Memory, Memory_Impl {
     explicit Impl(const Config &config, const MemoryLayout &layout) :
-        Memory(), Memory_Impl(config, layout) {}
+        Memory(), Memory_Impl(config, layout, Memory::cache) {}
 };
 
 auto Memory::get_impl() -> Impl & {
@@ -90,6 +105,25 @@ void Memory::store_u32(target_size_t addr, u32 value) {
     this->get_impl().check_store(addr, value);
 }
 
+template <std::integral _Int>
+auto Memory::load_slow(target_size_t addr) -> _Int {
+    return this->get_impl().checked_load <_Int> (addr);
+}
+
+template <std::unsigned_integral _Int>
+void Memory::store_slow(target_size_t addr, _Int value) {
+    this->get_impl().check_store(addr, value);
+}
+
+template auto Memory::load_slow <i8>  (target_size_t) -> i8;
+template auto Memory::load_slow <i16> (target_size_t) -> i16;
+template auto Memory::load_slow <i32> (target_size_t) -> i32;
+template auto Memory::load_slow <u8>  (target_size_t) -> u8;
+template auto Memory::load_slow <u16> (target_size_t) -> u16;
+template void Memory::store_slow <u8>  (target_size_t, u8);
+template void Memory::store_slow <u16> (target_size_t, u16);
+template void Memory::store_slow <u32> (target_size_t, u32);
+
 auto Memory::create(const Config &config, const MemoryLayout &result)
 -> std::unique_ptr <Memory> {
     auto ptr = new Memory::Impl { config, result };
@@ -121,7 +155,17 @@ auto Memory::create(const Config &config, const MemoryLayout &result)
 }
 
 auto Memory::sbrk(target_ssize_t inc) -> std::pair <char *, target_size_t> {
-    return this->get_impl().grow(inc);
+    auto &impl = this->get_impl();
+    // The heap would silently alias the stack, or wrap around the address space.
+    const auto [heap_low, heap_top] = static_cast <HeapArea &> (impl).get_range();
+    const auto [stack_low, stack_top] = static_cast <StackArea &> (impl).get_range();
+    panic_if(std::int64_t(heap_top) + inc > stack_low,
+        "Heap overflows into the stack: [0x{:x}, 0x{:x}) + {}", heap_low, heap_top, inc);
+    panic_if(std::int64_t(heap_top) + inc < heap_low,
+        "Heap shrinks below its start: [0x{:x}, 0x{:x}) + {}", heap_low, heap_top, inc);
+    // The heap may move or shrink.
+    this->cache.clear();
+    return impl.grow(inc);
 }
 
 auto Memory::get_text_range() -> Interval {
@@ -136,13 +180,23 @@ auto Memory::libc_access(target_size_t addr) -> std::span <char> {
     return this->get_impl().get_segment(addr);
 }
 
-void Memory::print_details(bool detail) const {
+void Memory::print_details(bool detail, const Device &dev) const {
     if (!detail) return;
-    panic("Memory details are not implemented yet.");
+    // Each load and store probes the cache once, and hits unless it misses.
+    const auto &count = static_cast <const config::CounterMemory &> (dev.counter);
+    const auto total = count.lb + count.lh + count.lw + count.lbu + count.lhu
+                     + count.sb + count.sh + count.sw;
+    if (total != 0) {
+        const auto hits = total - this->cache.misses;
+        console::profile << std::format(
+            "Memory region cache: {:.2f}% hit ({}/{})\n",
+            hits * 100.0 / total, hits, total
+        );
+    }
 }
 
 template <Error error, std::integral _Int>
-[[noreturn]]
+[[noreturn, gnu::cold, gnu::noinline]]
 static void handle_misaligned(target_size_t addr) {
     throw FailToInterpret {
         .error      = error,
@@ -154,7 +208,7 @@ static void handle_misaligned(target_size_t addr) {
 }
 
 template <Error error, std::integral _Int>
-[[noreturn]]
+[[noreturn, gnu::cold, gnu::noinline]]
 static void handle_outofbound(target_size_t addr) {
     throw FailToInterpret {
         .error      = error,
@@ -180,14 +234,8 @@ auto Memory_Impl::checked_load(target_size_t addr) -> _Int {
     if (addr % alignof(_Int) != 0)
         handle_misaligned <Error::LoadMisAligned, _Int> (addr);
 
-    if (this->in_data(addr, addr + sizeof(_Int)))
-        return int_cast <_Int> (this->get_static(addr));
-
-    if (this->in_heap(addr, addr + sizeof(_Int)))
-        return int_cast <_Int> (this->get_heap(addr));
-
-    if (this->in_stack(addr, addr + sizeof(_Int)))
-        return int_cast <_Int> (this->get_stack(addr));
+    if (auto *ptr = this->lookup(addr, sizeof(_Int)))
+        return int_cast <_Int> (ptr);
 
     handle_outofbound <Error::LoadOutOfBound, _Int> (addr);
 }
@@ -197,18 +245,43 @@ void Memory_Impl::check_store(target_size_t addr, _Int val) {
     if (addr % alignof(_Int) != 0)
         handle_misaligned <Error::StoreMisAligned, _Int> (addr);
 
-    if (this->in_data(addr, addr + sizeof(_Int)))
-        return void(int_cast <_Int> (this->get_static(addr)) = val);
-
-    if (this->in_heap(addr, addr + sizeof(_Int)))
-        return void(int_cast <_Int> (this->get_heap(addr)) = val);
-
-    if (this->in_stack(addr, addr + sizeof(_Int)))
-        return void(int_cast <_Int> (this->get_stack(addr)) = val);
+    if (auto *ptr = this->lookup(addr, sizeof(_Int)))
+        return void(int_cast <_Int> (ptr) = val);
 
     handle_outofbound <Error::StoreOutOfBound, _Int> (addr);
 }
 
+auto Memory_Impl::refill(target_size_t addr, std::size_t size) -> std::byte * {
+    using Region = RegionCache::Region;
+    this->cache.misses += 1;
+
+    std::array <Region, 3> regions;
+    if (auto *base = this->get_base(); base != nullptr) {
+        // With a flat space, data and heap form one range.
+        const auto data_low = StaticArea::get_data_range().start;
+        const auto heap_top = HeapArea::get_range().finish;
+        regions = {
+            Region { { data_low, heap_top }, base },
+            Region { StackArea::get_range(), base },
+            Region {},
+        };
+    } else {
+        regions = {
+            Region { StaticArea::get_data_range(), this->get_static(0) },
+            Region { HeapArea::get_range(), this->get_heap(0) },
+            Region { StackArea::get_range(), this->get_stack(0) },
+        };
+    }
+
+    for (const auto &region : regions) {
+        if (!RegionCache::in_window(region.range, addr, size)) continue;
+        this->cache.insert(region);
+        return region.base + addr;
+    }
+
+    return nullptr;
+}
+
 auto Memory_Impl::get_segment(target_size_t addr) -> std::span <char> {
     constexpr auto __wash = [](std::byte *ptr) -> char * {
         /// TODO: May be we should use std::launder here
@@ -0,0 +1,92 @@
+#include <interpreter/output.h>
+#include <utility/answer.h>
+#include <utility/error.h>
+#include <cerrno>
+#include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace dark {
+
+// Console messages go first, so that they stay in order with the output.
+static void sync_console(int fd) {
+    if (fd == STDOUT_FILENO) std::cout.flush();
+    if (fd == STDERR_FILENO) std::cerr.flush();
+}
+
+// Write all the pieces, retrying partial writes. Like a stream, errors are dropped.
+static void write_all(int fd, ::iovec *vec, int count) {
+    sync_console(fd);
+    while (count != 0) {
+        const auto done = ::writev(fd, vec, count);
+        if (done < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        auto left = static_cast <std::size_t> (done);
+        while (count != 0 && left >= vec->iov_len) {
+            left -= vec->iov_len;
+            ++vec, --count;
+        }
+        if (count != 0) {
+            vec->iov_base = static_cast <char *> (vec->iov_base) + left;
+            vec->iov_len -= left;
+        }
+    }
+}
+
+OutputBuffer::OutputBuffer(int fd) :
+    start(), cursor(), finish(), fd(fd), checker(), storage(new char[kBufferSize]) {
+    this->start = this->cursor = this->storage.get();
+    this->finish = this->start + kBufferSize;
+}
+
+OutputBuffer::OutputBuffer(AnswerChecker &checker) :
+    start(), cursor(), finish(), fd(-1), checker(&checker), storage(new char[kBufferSize]) {
+    this->start = this->cursor = this->storage.get();
+    this->finish = this->start + kBufferSize;
+}
+
+OutputBuffer::~OutputBuffer() {
+    // A wrong answer is still kept in the checker.
+    this->drain();
+}
+
+void OutputBuffer::write_slow(std::string_view str) {
+    if (str.size() >= kBufferSize) {
+        // Too large to be buffered, so it goes out along with the buffer.
+        if (this->checker != nullptr) {
+            this->flush();
+            panic_if(!this->checker->check(str), "Wrong Answer");
+        } else {
+            ::iovec vec[2] = {
+                { this->start, static_cast <std::size_t> (this->cursor - this->start) },
+                { const_cast <char *> (str.data()), str.size() },
+            };
+            write_all(this->fd, vec, 2);
+            this->cursor = this->start;
+        }
+        return;
+    }
+
+    this->flush();
+    std::memcpy(this->cursor, str.data(), str.size());
+    this->cursor += str.size();
+}
+
+void OutputBuffer::flush() {
+    panic_if(!this->drain(), "Wrong Answer");
+}
+
+// Empty the buffer, and return false only on a wrong answer.
+bool OutputBuffer::drain() {
+    if (this->cursor == this->start) return true;
+    const auto str = std::string_view { this->start, this->cursor };
+    this->cursor = this->start;
+    if (this->checker != nullptr) return this->checker->check(str);
+    ::iovec vec { this->start, str.size() };
+    write_all(this->fd, &vec, 1);
+    return true;
+}
+
+} // namespace dark
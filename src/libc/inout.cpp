@@ -5,13 +5,150 @@
 #include <interpreter/memory.h>
 #include <interpreter/register.h>
 #include <interpreter/exception.h>
+#include <algorithm>
+#include <charconv>
+#include <istream>
+#include <limits>
 #include <sstream>
+#include <string>
 
 namespace dark::libc::__details {
 
+/**
+ * A writer which formats into a host buffer, so that the stream
+ * is only written once in bulk, rather than once per piece.
+ */
+struct BufferWriter {
+  public:
+    explicit BufferWriter(std::string &buffer) : buffer(buffer) { buffer.clear(); }
+
+    void write(std::string_view str) { this->buffer.append(str); }
+    void put(char c) { this->buffer.push_back(c); }
+
+    template <int _Base, std::integral _Int>
+    void write_int(_Int value) {
+        char tmp[std::numeric_limits <_Int>::digits + 1];
+        auto [ptr, _] = std::to_chars(std::begin(tmp), std::end(tmp), value, _Base);
+        this->buffer.append(tmp, ptr);
+    }
+
+  private:
+    std::string &buffer;
+};
+
+/**
+ * A reader which works on the buffer of the input stream directly,
+ * and parses integers with from_chars, rather than stream extraction.
+ * The state of the stream is kept as if extracted by the stream.
+ */
+struct BufferReader {
+  public:
+    explicit BufferReader(std::istream &in) : in(in), buf(*in.rdbuf()) {}
+
+    auto get() -> int {
+        if (!this->in.good()) return this->fail();
+        const auto c = this->buf.sbumpc();
+        if (c == kEOF) return this->fail();
+        return c;
+    }
+
+    // Read a word, which is ended by a whitespace.
+    bool read_word(std::string &str) {
+        if (!this->skip_spaces()) return false;
+        str.clear();
+        for (int c ; (c = this->buf.sgetc()) != kEOF && !is_space(c) ; this->buf.sbumpc())
+            str.push_back(static_cast <char> (c));
+        if (this->buf.sgetc() == kEOF) this->in.setstate(std::ios::eofbit);
+        return true;
+    }
+
+    // Read an integer. On failure, value is set to 0 (or clamped if out of range).
+    template <std::integral _Int>
+    bool read_int(_Int &value) {
+        value = 0;
+        if (!this->skip_spaces()) return false;
+
+        char tmp[32];
+        std::size_t size = 0;
+        bool negative = false;
+
+        if (int c = this->buf.sgetc() ; c == '+' || c == '-') {
+            negative = (c == '-');
+            this->buf.sbumpc();
+        }
+
+        // Leading zeros are skipped, so that only significant digits are buffered.
+        // More of them than the buffer holds are still consumed, as an overflow.
+        int c;
+        bool has_digit = false;
+        bool too_long  = false;
+        for (; (c = this->buf.sgetc()) == '0' ; this->buf.sbumpc())
+            has_digit = true;
+        for (; c >= '0' && c <= '9' ; this->buf.sbumpc(), c = this->buf.sgetc()) {
+            if (size < std::size(tmp))
+                tmp[size++] = static_cast <char> (c);
+            else
+                too_long = true;
+        }
+        if (c == kEOF) this->in.setstate(std::ios::eofbit);
+        if (size == 0 && !has_digit) return this->fail(), false;
+        if (size == 0) tmp[size++] = '0';
+
+        // Unsigned values wrap around on negation, as strtoul does.
+        using _Wide_t = std::conditional_t <std::is_signed_v <_Int>, std::int64_t, std::uint64_t>;
+        _Wide_t wide {};
+        auto [_, ec] = std::from_chars(tmp, tmp + size, wide);
+        if (too_long) ec = std::errc::result_out_of_range;
+        if (ec == std::errc {} && negative) wide = -wide;
+
+        constexpr auto kMin = std::numeric_limits <_Int>::min();
+        constexpr auto kMax = std::numeric_limits <_Int>::max();
+        if constexpr (std::is_signed_v <_Int>) {
+            if (ec != std::errc {} || wide < kMin || wide > kMax) {
+                value = negative ? kMin : kMax;
+                return this->fail(), false;
+            }
+        } else {
+            if (ec != std::errc {} || (negative ? -wide : wide) > kMax) {
+                value = kMax;
+                return this->fail(), false;
+            }
+        }
+
+        value = static_cast <_Int> (wide);
+        return true;
+    }
+
+  private:
+    static constexpr int kEOF = std::char_traits <char>::eof();
+
+    std::istream &in;
+    std::streambuf &buf;
+
+    static bool is_space(int c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    auto fail() -> int {
+        if (!this->in.good() || this->buf.sgetc() == kEOF)
+            this->in.setstate(std::ios::eofbit);
+        this->in.setstate(std::ios::failbit);
+        return kEOF;
+    }
+
+    // Skip whitespaces, and return whether there is anything left.
+    bool skip_spaces() {
+        if (!this->in.good()) return this->fail(), false;
+        int c;
+        while ((c = this->buf.sgetc()) != kEOF && is_space(c)) this->buf.sbumpc();
+        if (c == kEOF) return this->fail(), false;
+        return true;
+    }
+};
+
 template <_Index index>
 static void checked_printf_impl(
-    RegisterFile &rf, Memory &mem, std::ostream &out,
+    RegisterFile &rf, Memory &mem, BufferWriter &out,
     std::string_view fmt, Register from
 ) {
     auto reg = reg_to_int(from);
@@ -25,33 +162,40 @@ static void checked_printf_impl(
     };
 
     for (std::size_t i = 0 ; i < fmt.size() ; ++i) {
-        char c = fmt[i];
-        if (c != '%') { out.put(c); continue; }
-        // c == '%' here
-        switch (fmt[++i]) {
+        // Literal text up to the next specifier is written at once.
+        if (fmt[i] != '%') {
+            const auto next = std::min(fmt.find('%', i), fmt.size());
+            out.write(fmt.substr(i, next - i));
+            i = next - 1;
+            continue;
+        }
+        // fmt[i] == '%' here, and a trailing '%' sees the null terminator.
+        const auto spec = ++i < fmt.size() ? fmt[i] : '\0';
+        switch (spec) {
             case 'd':
-                out << std::dec << static_cast<std::int32_t>(extra_arg());
+                out.write_int <10> (static_cast<std::int32_t>(extra_arg()));
                 break;
             case 's':
-                out << checked_get_string<_Index::printf>(mem, extra_arg());
+                out.write(checked_get_string<_Index::printf>(mem, extra_arg()));
                 break;
             case 'c':
                 out.put(static_cast<char>(extra_arg()));
                 break;
             case 'x':
-                out << std::hex << extra_arg();
+                out.write_int <16> (extra_arg());
                 break;
             case 'p':
-                out << "0x" << std::hex << extra_arg();
+                out.write("0x");
+                out.write_int <16> (extra_arg());
                 break;
             case 'u':
-                out << std::dec << static_cast<std::uint32_t>(extra_arg());
+                out.write_int <10> (static_cast<std::uint32_t>(extra_arg()));
                 break;
             case '%':
                 out.put('%');
                 break;
             default:
-                handle_unknown_fmt<index>(fmt[i]);
+                handle_unknown_fmt<index>(spec);
         }
     }
 }
@@ -59,7 +203,7 @@ static void checked_printf_impl(
 template <_Index index>
 [[nodiscard]]
 static auto checked_scanf_impl(
-    RegisterFile &rf, Memory &mem, std::istream &in,
+    RegisterFile &rf, Memory &mem, BufferReader &in,
     std::string_view fmt, Register from
 ) -> int {
     auto reg = reg_to_int(from);
@@ -85,32 +229,34 @@ static auto checked_scanf_impl(
 
         // c == '%' here
 
-        auto val_ch = char {};
         auto val_u  = target_size_t {};
         auto val_s  = target_ssize_t {};
 
-        switch (fmt[++i]) {
+        const auto spec = ++i < fmt.size() ? fmt[i] : '\0';
+        switch (spec) {
             case 'd':
-                in >> val_s;
+                in.read_int(val_s);
                 aligned_access<index, std::int32_t>(mem, extra_arg()) = val_s;
                 break;
             case 's': {
-                in >> buf;
+                in.read_word(buf);
                 auto ptr = extra_arg();
                 auto raw = checked_get_area <index> (mem, ptr, buf.size() + 1);
                 std::memcpy(raw, buf.data(), buf.size() + 1);
                 break;
             }
-            case 'c':
-                in.get(val_ch); // don't skip whitespace
+            case 'c': {
+                auto got = in.get(); // don't skip whitespace
+                auto val_ch = got == std::char_traits <char>::eof() ? char {} : static_cast <char> (got);
                 aligned_access<index, char>(mem, extra_arg()) = val_ch;
                 break;
+            }
             case 'u':
-                in >> val_u;
+                in.read_int(val_u);
                 aligned_access<index, std::uint32_t>(mem, extra_arg()) = val_u;
                 break;
             default:
-                handle_unknown_fmt<index>(fmt[i]);
+                handle_unknown_fmt<index>(spec);
         }
     }
 
@@ -120,55 +266,70 @@ static auto checked_scanf_impl(
 auto puts(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr = rf[Register::a0];
     auto str = checked_get_string<_Index::puts>(mem, ptr);
-    dev.out << str << '\n';
-    return return_to_user(rf, mem, 0);
+    dev.out.write(str);
+    dev.out.put('\n');
+    return return_to_user(rf, mem, dev, 0);
 }
 
 auto putchar(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto c = rf[Register::a0];
     dev.out.put(static_cast<char>(c));
-    return return_to_user(rf, mem, 0);
+    return return_to_user(rf, mem, dev, 0);
 }
 
+// The host buffer of printf and sprintf, which is reused across calls.
+static std::string format_buffer;
+
 auto printf(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr = rf[Register::a0];
     auto fmt = checked_get_string<_Index::printf>(mem, ptr);
-    auto &os = dev.out;
 
-    checked_printf_impl <_Index::printf> (rf, mem, os, fmt, Register::a1);
-    return return_to_user(rf, mem, 0);
+    BufferWriter out { format_buffer };
+    checked_printf_impl <_Index::printf> (rf, mem, out, fmt, Register::a1);
+    dev.out.write(format_buffer);
+    return return_to_user(rf, mem, dev, 0);
 }
 
-auto sprintf(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto sprintf(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
     auto fmt  = checked_get_string<_Index::sprintf>(mem, ptr1);
 
-    std::stringstream ss;
-    checked_printf_impl <_Index::sprintf> (rf, mem, ss, fmt, Register::a2);
+    BufferWriter out { format_buffer };
+    checked_printf_impl <_Index::sprintf> (rf, mem, out, fmt, Register::a2);
 
-    auto str  = std::move(ss).str();
+    const auto &str = format_buffer;
     auto raw  = checked_get_area<_Index::sprintf>(mem, ptr0, str.size() + 1);
 
     std::memcpy(raw, str.data(), str.size() + 1);
-    return return_to_user(rf, mem, ptr0);
+    return return_to_user(rf, mem, dev, ptr0);
 }
 
 auto getchar(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
-    auto c = dev.in.get();
-    return return_to_user(rf, mem, c);
+    // Output so far goes out first if someone may wait on it, as a prompt would.
+    // Then read from the buffer directly, skipping the sentry of a good stream.
+    if (dev.interactive) dev.out.flush();
+    auto &in = dev.in;
+    if (in.rdstate() != std::ios::goodbit) [[unlikely]]
+        return return_to_user(rf, mem, dev, in.get());
+
+    auto c = in.rdbuf()->sbumpc();
+    if (c == std::istream::traits_type::eof())
+        in.setstate(std::ios::eofbit | std::ios::failbit);
+    return return_to_user(rf, mem, dev, c);
 }
 
 auto scanf(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr = rf[Register::a0];
     auto fmt = checked_get_string<_Index::scanf>(mem, ptr);
-    auto &is = dev.in;
 
-    auto result = checked_scanf_impl <_Index::scanf> (rf, mem, is, fmt, Register::a1);
-    return return_to_user(rf, mem, result);
+    if (dev.interactive) dev.out.flush();
+    BufferReader in { dev.in };
+    auto result = checked_scanf_impl <_Index::scanf> (rf, mem, in, fmt, Register::a1);
+    return return_to_user(rf, mem, dev, result);
 }
 
-auto sscanf(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto sscanf(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
     auto str  = checked_get_string<_Index::sscanf>(mem, ptr0);
@@ -176,17 +337,18 @@ auto sscanf(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
 
     std::stringstream ss { std::string(str) };
 
-    auto result = checked_scanf_impl <_Index::sscanf> (rf, mem, ss, fmt, Register::a2);
-    return return_to_user(rf, mem, result);
+    BufferReader in { ss };
+    auto result = checked_scanf_impl <_Index::sscanf> (rf, mem, in, fmt, Register::a2);
+    return return_to_user(rf, mem, dev, result);
 }
 
-auto memset(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto memset(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr  = rf[Register::a0];
     auto fill = rf[Register::a1];
     auto size = rf[Register::a2];
     auto raw  = checked_get_area<_Index::memset>(mem, ptr, size);
     std::memset(raw, fill, size);
-    return return_to_user(rf, mem, ptr);
+    return return_to_user(rf, mem, dev, ptr);
 }
 
 } // namespace dark::libc::__details
@@ -14,11 +14,15 @@ void libc_init(RegisterFile &, Memory &mem, Device &) {
     malloc_manager.init(mem);
 }
 
+void print_details(bool) {
+    malloc_manager.print_details();
+}
+
 void MemoryManager::unknown_malloc_pointer(target_size_t ptr, __details::_Index index) {
     throw FailToInterpret {
         .error      = Error::LibcError,
         .libc_which = static_cast<libc_index_t>(index),
-        .message    = std::format("Not a malloc pointer: 0x{:#x}", ptr),
+        .message    = std::format("Not a malloc pointer: 0x{:x}", ptr),
     };
 }
 
@@ -26,32 +30,32 @@ void MemoryManager::unknown_malloc_pointer(target_size_t ptr, __details::_Index
 
 namespace dark::libc::__details {
 
-auto malloc(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto malloc(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto size = rf[Register::a0];
     auto [_, retval] = malloc_manager.allocate(mem, size);
-    return return_to_user(rf, mem, retval);
+    return return_to_user(rf, mem, dev, retval);
 }
 
-auto calloc(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto calloc(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto size = rf[Register::a0] * rf[Register::a1];
     auto [ptr, retval] = malloc_manager.allocate(mem, size);
     std::memset(ptr, 0, size);
-    return return_to_user(rf, mem, retval);
+    return return_to_user(rf, mem, dev, retval);
 }
 
-auto realloc(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto realloc(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto old_data = rf[Register::a0];
     auto new_size = rf[Register::a1];
     auto retval = malloc_manager.reallocate(mem, old_data, new_size);
-    return return_to_user(rf, mem, retval);
+    return return_to_user(rf, mem, dev, retval);
 }
 
-auto free(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto free(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     malloc_manager.free(mem, rf[Register::a0]);
-    return return_to_user(rf, mem, 0);
+    return return_to_user(rf, mem, dev, 0);
 }
 
-auto memcmp(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto memcmp(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
     auto size = rf[Register::a2];
@@ -59,10 +63,10 @@ auto memcmp(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
     auto [lhs, rhs] = checked_get_areas<_Index::memcmp>(mem, ptr0, ptr1, size);
 
     auto result = std::memcmp(lhs, rhs, size);
-    return return_to_user(rf, mem, result);
+    return return_to_user(rf, mem, dev, result);
 }
 
-auto memcpy(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto memcpy(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
     auto size = rf[Register::a2];
@@ -70,10 +74,10 @@ auto memcpy(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
     auto [dst, src] = checked_get_areas<_Index::memcpy>(mem, ptr0, ptr1, size);
 
     std::memcpy(dst, src, size);
-    return return_to_user(rf, mem, ptr0);
+    return return_to_user(rf, mem, dev, ptr0);
 }
 
-auto memmove(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto memmove(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
     auto size = rf[Register::a2];
@@ -81,7 +85,7 @@ auto memmove(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
     auto [dst, src] = checked_get_areas<_Index::memmove>(mem, ptr0, ptr1, size);
 
     std::memmove(dst, src, size);
-    return return_to_user(rf, mem, ptr0);
+    return return_to_user(rf, mem, dev, ptr0);
 }
 
 } // namespace dark::libc::__details
@@ -5,50 +5,106 @@
 #include <interpreter/memory.h>
 #include <interpreter/register.h>
 #include <interpreter/exception.h>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <cstring>
+#include <optional>
+#include <span>
 
 namespace dark::libc::__details {
 
-auto strcpy(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+/**
+ * The bound of a one-pass copy, within both areas. The copy reads each chunk
+ * before writing it, which is only safe if the destination is not just ahead
+ * of the source, as the source could be overwritten before read.
+ */
+static auto get_copy_bound(std::span <char> dst, std::span <char> src)
+-> std::optional <std::size_t> {
+    const auto bound = std::min(dst.size(), src.size());
+    const auto distance = std::bit_cast <std::uintptr_t> (dst.data())
+                        - std::bit_cast <std::uintptr_t> (src.data());
+    if (dst.data() > src.data() && distance < bound) return std::nullopt;
+    return bound;
+}
+
+auto strcpy(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
 
+    auto area0 = mem.libc_access(ptr0);
+    auto area1 = mem.libc_access(ptr1);
+
+    if (auto bound = get_copy_bound(area0, area1)) [[likely]] {
+        if (bounded_copy(area0.data(), area1.data(), *bound) != *bound)
+            return return_to_user(rf, mem, dev, ptr0);
+        // Not terminated within both areas, so the checks below must fail.
+        // Only non-zero bytes are copied, so the source keeps its length.
+    }
+
     auto str  = checked_get_string<_Index::strcpy>(mem, ptr1);
     auto size = str.size() + 1;
     auto raw  = checked_get_area<_Index::strcpy>(mem, ptr0, size);
 
-    std::memcpy(raw, str.data(), size);
-    return return_to_user(rf, mem, ptr0);
+    std::memmove(raw, str.data(), size);
+    return return_to_user(rf, mem, dev, ptr0);
 }
 
-auto strlen(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto strlen(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr = rf[Register::a0];
     auto str = checked_get_string<_Index::strlen>(mem, ptr);
-    return return_to_user(rf, mem, str.size());
+    return return_to_user(rf, mem, dev, str.size());
 }
 
-auto strcat(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto strcat(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
 
+    auto area0 = mem.libc_access(ptr0);
+    auto area1 = mem.libc_access(ptr1);
+
+    // Append at the end of str0, in one pass over str1.
+    auto tail = area0.subspan(bounded_length(area0.data(), area0.size()));
+    if (auto bound = get_copy_bound(tail, area1)) [[likely]] {
+        if (bounded_copy(tail.data(), area1.data(), *bound) != *bound)
+            return return_to_user(rf, mem, dev, ptr0);
+        // Not terminated within both areas, so the checks below must fail.
+        // The terminator of str0 may be overwritten, so it is not scanned again.
+        checked_get_string<_Index::strcat>(mem, ptr1);
+        handle_outofbound<_Index::strcat>(ptr0 + area0.size(), sizeof(char));
+    }
+
     auto str1 = checked_get_string<_Index::strcat>(mem, ptr1);
     auto str0 = checked_get_string<_Index::strcat>(mem, ptr0, str1.size());
     auto raw  = const_cast<char *>(str0.end());
 
     // Copy the string and the null terminator
-    std::memcpy(raw, str1.data(), str1.size() + 1);
-    return return_to_user(rf, mem, ptr0);
+    std::memmove(raw, str1.data(), str1.size() + 1);
+    return return_to_user(rf, mem, dev, ptr0);
 }
 
-auto strcmp(Executable &, RegisterFile &rf, Memory &mem, Device &) -> Hint {
+auto strcmp(Executable &, RegisterFile &rf, Memory &mem, Device &dev) -> Hint {
     auto ptr0 = rf[Register::a0];
     auto ptr1 = rf[Register::a1];
 
-    auto str0 = checked_get_string<_Index::strcmp>(mem, ptr0);
-    auto str1 = checked_get_string<_Index::strcmp>(mem, ptr1);
+    auto area0 = mem.libc_access(ptr0);
+    auto area1 = mem.libc_access(ptr1);
+    auto where = bounded_mismatch(area0.data(), area1.data(), std::min(area0.size(), area1.size()));
+
+    // Both strings must still be terminated within their areas.
+    const auto terminated = [where](std::span <char> area) {
+        return where < area.size()
+            && (area[where] == 0 || bounded_length(&area[where], area.size() - where) < area.size() - where);
+    };
+
+    if (!terminated(area0) || !terminated(area1)) [[unlikely]] {
+        checked_get_string<_Index::strcmp>(mem, ptr0);
+        checked_get_string<_Index::strcmp>(mem, ptr1);
+        unreachable("Unterminated string passes the check\n");
+    }
 
-    auto result = std::strcmp(str0.data(), str1.data());
-    return return_to_user(rf, mem, result);
+    auto result = static_cast<unsigned char>(area0[where]) - static_cast<unsigned char>(area1[where]);
+    return return_to_user(rf, mem, dev, result);
 }
 
 } // namespace dark::libc::__details
\ No newline at end of file
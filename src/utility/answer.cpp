@@ -0,0 +1,52 @@
+#include <utility/answer.h>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dark {
+
+AnswerChecker::AnswerChecker(const char *data, std::size_t size) :
+    data(data), size(size), offset(), failed() {}
+
+auto AnswerChecker::create(std::string_view path) -> std::unique_ptr <AnswerChecker> {
+    const auto name = std::string(path);
+    const int fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return nullptr;
+
+    struct ::stat info {};
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    // An empty file cannot be mapped, and needs no data anyway.
+    const auto size = static_cast <std::size_t> (info.st_size);
+    void *ptr = nullptr;
+    if (size != 0) {
+        ptr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) ::madvise(ptr, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    if (ptr == MAP_FAILED) return nullptr;
+
+    return std::unique_ptr <AnswerChecker> (new AnswerChecker { static_cast <const char *> (ptr), size });
+}
+
+AnswerChecker::~AnswerChecker() {
+    if (this->size != 0) ::munmap(const_cast <char *> (this->data), this->size);
+}
+
+bool AnswerChecker::check(std::string_view str) {
+    if (this->failed) return false;
+    if (str.empty()) return true;
+    if (str.size() > this->size - this->offset
+     || std::memcmp(this->data + this->offset, str.data(), str.size()) != 0)
+        return this->failed = true, false;
+    this->offset += str.size();
+    return true;
+}
+
+} // namespace dark
@@ -8,6 +8,7 @@
 #include <config/default.h>
 #include <config/weight.h>
 #include <config/argument.h>
+#include <utility/answer.h>
 #include <unordered_set>
 #include <unordered_map>
 #include <fstream>
@@ -15,7 +16,8 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
-#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace dark {
 
@@ -34,7 +36,7 @@ void ArgumentParser::handle(std::string_view str) {
     panic("Fail to parse command line argument.\n  {}", str);
 }
 
-using _Option_Set_t = std::unordered_set <std::string_view>;
+using _Option_Map_t = std::unordered_map <std::string_view, std::string_view>;
 using _Weight_Map_t = std::unordered_map <std::string_view, std::size_t>;
 
 struct InputFile {
@@ -127,26 +129,90 @@ private:
     std::string_view name;
 };
 
+struct ProgramOutput {
+    explicit ProgramOutput(std::string_view name) : name(name) {}
+    ProgramOutput(const ProgramOutput &) = delete;
+
+    ~ProgramOutput() {
+        if (this->owning) ::close(this->fd);
+    }
+
+    auto get_name() const -> std::string_view {
+        return this->name;
+    }
+
+    auto get_file_name() const -> std::optional <std::string_view> {
+        using _Option_t = std::optional <std::string_view>;
+        return this->name == config::kStdout
+            || this->name == config::kStderr ? _Option_t {} : this->name;
+    }
+
+    auto get_fd() const -> int {
+        runtime_assert(this->fd != -1);
+        return this->fd;
+    }
+
+    auto get_checker() const -> AnswerChecker * {
+        return this->checker;
+    }
+
+    // The output is written with raw file descriptors, not streams.
+    auto init_file() -> void {
+        runtime_assert(this->fd == -1 && this->checker == nullptr);
+        if (this->name == config::kStdout) {
+            this->fd = STDOUT_FILENO;
+        } else if (this->name == config::kStderr) {
+            this->fd = STDERR_FILENO;
+        } else {
+            const auto path = std::string(this->name);
+            this->fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (this->fd == -1)
+                handle_error("Cannot open output file: {}", this->name);
+            this->owning = true;
+        }
+    }
+
+    auto init_checker(AnswerChecker *checker) -> void {
+        runtime_assert(this->fd == -1 && this->checker == nullptr);
+        this->checker = checker;
+    }
+
+    auto try_init() -> bool {
+        if (this->fd == -1 && this->checker == nullptr) {
+            this->init_file();
+            return true;
+        }
+        return false;
+    }
+
+private:
+    int fd = -1;
+    bool owning = false;
+    AnswerChecker *checker = nullptr;
+    std::string_view name;
+};
+
 struct OJInfo {
     std::unique_ptr <std::ostringstream> error;
-    std::unique_ptr <std::ostringstream> output;
+    std::unique_ptr <AnswerChecker> checker;
     std::unique_ptr <std::ostringstream> profile;
 };
 
 struct Config_Impl {
     InputFile  input;   // Program input
-    OutputFile output;  // Program output
+    ProgramOutput output;   // Program output
     OutputFile profile; // Profile output
     const std::string_view answer;  // Answer file
 
     const std::size_t max_timeout = {};       // Maximum time
+    const std::size_t max_cycles  = {};       // Maximum cycles
     const std::size_t memory_size = {};       // Memory storage 
     const std::size_t stack_size  = {};       // Maximum stack
 
     const std::vector <std::string_view> assembly_files;  // Assembly files
 
-    // The additional configuration table provided by the user.
-    _Option_Set_t option_table;
+    // The additional configuration table provided by the user, with optional values.
+    _Option_Map_t option_table;
     // The additional weight table provided by the user.
     _Weight_Map_t weight_table;
 
@@ -155,7 +221,7 @@ struct Config_Impl {
     explicit Config_Impl(ArgumentParser &parser);
 
     bool has_option(std::string_view) const;
-    void add_option(std::string_view);
+    void add_option(std::string_view, std::string_view = {});
     void print_in_detail() const;
     void initialize();
     void initialize_with_check();
@@ -200,10 +266,11 @@ static auto find_weight_range(std::string_view need)
     return std::nullopt;
 }
 
-static void check_invalid_weight(_Weight_Map_t &table) {
+static void check_invalid_weight(_Weight_Map_t &table, std::size_t memory) {
     _Weight_Map_t default_weights {
         std::begin(kWeightList), std::end(kWeightList)
     };
+    for (auto name : weight::memory_name_list) default_weights[name] = memory;
 
     for (const auto &[key, value] : table) {
         // Name of a specific weight, ok.
@@ -327,6 +394,9 @@ Config_Impl::Config_Impl(ArgumentParser &parser) :
     max_timeout(parser.match<KeyValue>({"-t", "--time"})
         .transform([](std::string_view str) { return get_integer(str, "--time"); })
         .value_or(config::kInitTimeOut)),
+    max_cycles(parser.match<KeyValue>({"-c", "--cycles"})
+        .transform([](std::string_view str) { return get_integer(str, "--cycles"); })
+        .value_or(config::kInitCycleLimit)),
     memory_size(parser.match<KeyValue>({"-m", "--memory"})
         .transform([](std::string_view str) { return get_memory(str, "--memory"); })
         .value_or(config::kInitMemorySize)),
@@ -345,6 +415,11 @@ Config_Impl::Config_Impl(ArgumentParser &parser) :
             this->add_option(option.substr(2));
         });
 
+    for (auto option : config::kValueOptions)
+        parser.match<KeyOptional>({option}, [this, option](std::string_view value) {
+            this->add_option(option.substr(2), value);
+        });
+
     for (auto [name, weight] : parser.get_map()) {
         std::string_view what;
         if (name.starts_with("--weight-")) {
@@ -365,8 +440,8 @@ bool Config_Impl::has_option(std::string_view name) const {
     return this->option_table.contains(name);
 }
 
-void Config_Impl::add_option(std::string_view name) {
-    this->option_table.insert(name);
+void Config_Impl::add_option(std::string_view name, std::string_view value) {
+    this->option_table.try_emplace(name, value);
 }
 
 void Config_Impl::initialize() {
@@ -383,8 +458,6 @@ void Config_Impl::initialize_with_check() {
         handle_error("Stack size exceeds memory size: "
             "0x{:x} > 0x{:x}", this->stack_size, this->memory_size);
 
-    check_invalid_weight(this->weight_table);
-
     check_duplicate_files(this->assembly_files,
         this->input.get_file_name(),
         // Remark: answer file is only useful in OJ mode for now.
@@ -407,9 +480,16 @@ void Config_Impl::initialize_configuration() {
         console::profile.rdbuf(nullptr);
     };
 
+    const auto __cache = [&] {
+        this->add_option("l1i");
+        this->add_option("l1d");
+        this->add_option("l2");
+    };
+
     const auto __all = [&] {
         this->add_option("cache");
         this->add_option("predictor");
+        __cache();
     };
 
     const auto __oj_mode = [&] {
@@ -432,14 +512,18 @@ void Config_Impl::initialize_configuration() {
         __all();
         __silent();
 
+        // The answer is mapped, and checked as the output is flushed.
+        this->oj_data.checker = AnswerChecker::create(this->answer);
+        if (this->oj_data.checker == nullptr)
+            handle_error("Cannot open answer file: {}", this->answer);
+
         this->oj_data.error = std::make_unique <std::ostringstream> ();
-        this->oj_data.output = std::make_unique <std::ostringstream> ();
         this->oj_data.profile = std::make_unique <std::ostringstream> ();
 
         console::error.rdbuf(this->oj_data.error->rdbuf());
         console::profile.rdbuf(this->oj_data.profile->rdbuf());
 
-        this->output.init_stream(this->oj_data.output.get());
+        this->output.init_checker(this->oj_data.checker.get());
         this->profile.init_stream(this->oj_data.profile.get());
     };
 
@@ -449,11 +533,24 @@ void Config_Impl::initialize_configuration() {
         this->print_in_detail();
     };
 
+    // A data cache makes memory commands cost the hit latency of its first level.
+    const auto __weight = [&] {
+        auto memory = weight::kMemory;
+        if (this->has_option("l1d"))        memory = weight::kMemoryL1;
+        else if (this->has_option("l2"))    memory = weight::kMemoryL2;
+        check_invalid_weight(this->weight_table, memory);
+    };
+
     // OJ-mode overrides all other options.
-    if (this->has_option("oj-mode")) return __oj_mode();
+    if (this->has_option("oj-mode")) {
+        __oj_mode();
+        return __weight();
+    }
     if (this->has_option("silent"))  __silent();
-    if (this->has_option("detail"))  __detail();
     if (this->has_option("all"))     __all();
+    if (this->has_option("cache"))   __cache();
+    __weight();
+    if (this->has_option("detail"))  __detail();
 }
 
 void Config_Impl::print_in_detail() const {
@@ -479,6 +576,12 @@ void Config_Impl::print_in_detail() const {
         message << std::format("  Maximum time: {} cycles\n", this->max_timeout);
     }
 
+    if (this->max_cycles == config::kInitCycleLimit) {
+        message << "  Maximum cycles: no limit\n";
+    } else {
+        message << std::format("  Maximum cycles: {}\n", this->max_cycles);
+    }
+
     // Format string for printing options and weights
     static constexpr char kFormat[] = "    - {:<10} = {}\n";
 
@@ -487,6 +590,17 @@ void Config_Impl::print_in_detail() const {
         auto option = key.substr(2); // substr(2) to remove "--" prefix
         message << std::format(kFormat, option, this->has_option(option));
     }
+    for (const auto &key : config::kValueOptions) {
+        auto option = key.substr(2);
+        auto iter = this->option_table.find(option);
+        if (iter == this->option_table.end()) {
+            message << std::format(kFormat, option, false);
+        } else if (iter->second.empty()) {
+            message << std::format(kFormat, option, true);
+        } else {
+            message << std::format(kFormat, option, iter->second);
+        }
+    }
 
     message << "  Weights:\n";
     for (const auto &[name, list, weight] : kWeightRanges) {
@@ -506,28 +620,24 @@ void Config_Impl::print_in_detail() const {
     message << std::format("\n{:=^80}\n\n", "");
 }
 
-static auto read_answer(std::string_view name) -> std::string {
-    std::string path { name };
-    const auto file_size = std::filesystem::file_size(path);
-    std::string retval;
-    retval.resize(file_size);
-    std::ifstream file { path, std::ios::binary };
-    file.read(retval.data(), file_size);
-    return retval;
-}
-
 void Config_Impl::oj_handle() {
     // using console::message;
+    const auto &checker = *this->oj_data.checker;
+
+    // A mismatch aborts the run, so it goes before any error.
+    if (checker.has_failed()) {
+        std::cerr << "Wrong answer.\n";
+        return;
+    }
+
     auto error_str = std::move(*this->oj_data.error).str();
     if (!error_str.empty()) {
         std::cerr << "Fatal Error:\n" << error_str;
         return;
     }
 
-    auto output_str = std::move(*this->oj_data.output).str();
-    auto answer_str = read_answer(this->answer);
-
-    if (output_str != answer_str) {
+    // The output so far matches, but may be shorter than the answer.
+    if (!checker.is_accepted()) {
         std::cerr << "Wrong answer.\n";
         return;
     }
@@ -562,6 +672,12 @@ auto Config::has_option(std::string_view name) const -> bool {
     return this->get_impl().has_option(name);
 }
 
+auto Config::get_option_value(std::string_view name) const -> std::string_view {
+    const auto &table = this->get_impl().option_table;
+    auto iter = table.find(name);
+    return iter == table.end() ? std::string_view {} : iter->second;
+}
+
 auto Config::get_impl() const -> const Impl & {
     return *static_cast <const Impl*> (this);
 }
@@ -570,8 +686,12 @@ auto Config::get_input_stream() const -> std::istream& {
     return this->get_impl().input.get_stream();
 }
 
-auto Config::get_output_stream() const -> std::ostream& {
-    return this->get_impl().output.get_stream();
+auto Config::get_output_fd() const -> int {
+    return this->get_impl().output.get_fd();
+}
+
+auto Config::get_answer_checker() const -> AnswerChecker * {
+    return this->get_impl().output.get_checker();
 }
 
 auto Config::get_stack_top() const -> target_size_t {
@@ -586,6 +706,10 @@ auto Config::get_timeout() const -> std::size_t {
     return this->get_impl().max_timeout;
 }
 
+auto Config::get_cycle_limit() const -> std::size_t {
+    return this->get_impl().max_cycles;
+}
+
 auto Config::get_assembly_names() const -> std::span <const std::string_view> {
     return this->get_impl().assembly_files;
 }
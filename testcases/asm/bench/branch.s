@@ -0,0 +1,55 @@
+# Branch prediction micro-benchmark.
+# 1. Loop:      a counted loop, which is always taken but the last time.
+# 2. Pattern:   a branch taken every third time, which needs history.
+# 3. Random:    a branch on a bit of a linear congruential generator.
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -16
+    sw ra, 12(sp)
+
+    # 1. Loop
+    li t3, 1000
+.Lloop_outer:
+    li t0, 100
+.Lloop:
+    addi t0, t0, -1
+    bnez t0, .Lloop
+    addi t3, t3, -1
+    bnez t3, .Lloop_outer
+
+    # 2. Pattern
+    li t0, 100000
+    li t1, 0
+    li t2, 3
+    li a0, 0
+.Lpattern:
+    addi t1, t1, 1
+    bne t1, t2, .Lpattern_skip
+    li t1, 0
+    addi a0, a0, 1
+.Lpattern_skip:
+    addi t0, t0, -1
+    bnez t0, .Lpattern
+
+    # 3. Random
+    li t0, 100000
+    li t1, 12345
+    li t2, 1103
+    li a0, 0
+.Lrandom:
+    mul t1, t1, t2
+    addi t1, t1, 1013
+    srli t3, t1, 7
+    andi t3, t3, 1
+    beqz t3, .Lrandom_skip
+    addi a0, a0, 1
+.Lrandom_skip:
+    addi t0, t0, -1
+    bnez t0, .Lrandom
+
+    li a0, 0
+    lw ra, 12(sp)
+    addi sp, sp, 16
+    ret
@@ -0,0 +1,72 @@
+# Memory access micro-benchmark.
+# 1. Stack only:        spill and reload locals.
+# 2. Static array:      walk an array in .bss.
+# 3. Stack and heap:    copy a malloc'd array through the stack.
+    .text
+    .align    2
+    .globl    main
+main:
+    addi sp, sp, -32
+    sw ra, 28(sp)
+    sw s0, 24(sp)
+    sw s1, 20(sp)
+
+    # 1. Stack only
+    li t0, 1000000
+.Lstack:
+    sw t0, 0(sp)
+    sw t0, 4(sp)
+    lw t1, 0(sp)
+    lw t2, 4(sp)
+    addi t0, t0, -1
+    bnez t0, .Lstack
+
+    # 2. Static array
+    li t3, 250
+.Lstatic_outer:
+    la t0, array
+    li t1, 1024
+.Lstatic:
+    lw t2, 0(t0)
+    addi t2, t2, 1
+    sw t2, 0(t0)
+    addi t0, t0, 4
+    addi t1, t1, -1
+    bnez t1, .Lstatic
+    addi t3, t3, -1
+    bnez t3, .Lstatic_outer
+
+    # 3. Stack and heap
+    li a0, 4096
+    call malloc
+    mv s0, a0
+    li s1, 250
+.Lheap_outer:
+    mv t0, s0
+    li t1, 1024
+.Lheap:
+    lw t2, 0(t0)
+    sw t2, 8(sp)
+    lw t2, 8(sp)
+    addi t2, t2, 1
+    sw t2, 0(t0)
+    addi t0, t0, 4
+    addi t1, t1, -1
+    bnez t1, .Lheap
+    addi s1, s1, -1
+    bnez s1, .Lheap_outer
+
+    mv a0, s0
+    call free
+
+    li a0, 0
+    lw s1, 20(sp)
+    lw s0, 24(sp)
+    lw ra, 28(sp)
+    addi sp, sp, 32
+    ret
+
+    .bss
+    .align 2
+array:
+    .zero 4096
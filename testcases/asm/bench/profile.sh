@@ -0,0 +1,18 @@
+# Usage: sh profile.sh [options...]
+# Check that two runs of the same program give the same profile,
+# for each kind of branch predictor, so that results can be reused.
+first=$(mktemp)
+second=$(mktemp)
+status=0
+for kind in bimodal gshare tournament tage; do
+    reimu -f=branch.s -o=/dev/null -p=$first --all --predictor=$kind "$@" > /dev/null 2>&1
+    reimu -f=branch.s -o=/dev/null -p=$second --all --predictor=$kind "$@" > /dev/null 2>&1
+    if [ -s $first ] && cmp -s $first $second; then
+        echo "$kind: same profile"
+    else
+        echo "$kind: different profiles"
+        status=1
+    fi
+done
+rm -f $first $second
+exit $status
@@ -0,0 +1,12 @@
+# Usage: sh run.sh [options...]
+# Print the memory region cache hit rate and the time per memory access.
+# The time is the whole interpret time divided by the memory accesses.
+for flags in "" "--flat"; do
+    reimu -f=memory.s -o=/dev/null --detail $flags "$@" 2>&1 | awk -v flags="$flags" '
+        /Memory region cache/   { hit = $4 }
+        /# mem/                 { mem = $4 }
+        /Interpret time/        { match($0, /[0-9]+ms/); ms = substr($0, RSTART, RLENGTH - 2) }
+        END {
+            printf "%-8s hit rate = %s, %.2f ns/access\n", flags == "" ? "default" : flags, hit, ms * 1e6 / mem
+        }'
+done
@@ -0,0 +1,37 @@
+    .text
+    .align    2
+    .globl    main
+# Expected: a fatal error on the second free of q,
+# which has been merged into the free chunk of p.
+main:
+    sw ra, -4(sp)
+    sw s0, -8(sp)
+    sw s1, -12(sp)
+    addi sp, sp, -32
+
+    li a0, 64
+    call malloc
+    mv s0, a0
+    li a0, 64
+    call malloc
+    mv s1, a0
+    li a0, 64
+    call malloc # keep q away from the top of heap
+
+    mv a0, s0
+    call free
+    mv a0, s1
+    call free
+    mv a0, s1
+    call free
+
+    la a0, .str.1
+    addi sp, sp, 32
+    lw s1, -12(sp)
+    lw s0, -8(sp)
+    lw ra, -4(sp)
+    tail puts
+
+    .data
+.str.1:
+    .string     "double_free_not_caught"
@@ -0,0 +1,58 @@
+    .text
+    .align    2
+    .globl    main
+main:
+    sw ra, -4(sp)
+    sw s0, -8(sp)
+    sw s1, -12(sp)
+    sw s2, -16(sp)
+    addi sp, sp, -32
+
+    li a0, 64
+    call malloc
+    mv s0, a0
+    li a0, 64
+    call malloc
+    mv s1, a0
+    li a0, 64
+    call malloc
+    mv s2, a0
+    li a0, 16
+    call malloc # keep the blocks away from the top of heap
+
+    # Forward: free q, then p, which absorbs q
+    mv a0, s1
+    call free
+    mv a0, s0
+    call free
+    li a0, 144 # two 80-byte chunks, minus one header
+    call malloc
+    bne a0, s0, fail
+
+    # Backward: free p, then q, which is absorbed into p
+    mv a0, s0
+    call free
+    mv a0, s2
+    call free
+    li a0, 224 # three 80-byte chunks, minus one header
+    call malloc
+    bne a0, s0, fail
+
+    la a0, .str.2
+end:
+    addi sp, sp, 32
+    lw s2, -16(sp)
+    lw s1, -12(sp)
+    lw s0, -8(sp)
+    lw ra, -4(sp)
+    tail puts
+
+fail:
+    la a0, .str.1
+    j end
+
+    .data
+.str.1:
+    .string     "fail_to_coalesce"
+.str.2:
+    .string     "success"
@@ -0,0 +1,44 @@
+    .text
+    .align    2
+    .globl    main
+main:
+    sw ra, -4(sp)
+    sw s0, -8(sp)
+    sw s1, -12(sp)
+    addi sp, sp, -32
+
+    li a0, 200
+    call malloc
+    mv s0, a0
+    li a0, 16
+    call malloc # keep the block away from the top of heap
+
+    # The freed block is split to serve two smaller ones
+    mv a0, s0
+    call free
+    li a0, 64
+    call malloc
+    bne a0, s0, fail
+    mv s1, a0
+    li a0, 64
+    call malloc
+    addi t0, s1, 80 # 64 bytes + 8 bytes header, aligned to 16
+    bne a0, t0, fail
+
+    la a0, .str.2
+end:
+    addi sp, sp, 32
+    lw s1, -12(sp)
+    lw s0, -8(sp)
+    lw ra, -4(sp)
+    tail puts
+
+fail:
+    la a0, .str.1
+    j end
+
+    .data
+.str.1:
+    .string     "fail_to_reuse"
+.str.2:
+    .string     "success"
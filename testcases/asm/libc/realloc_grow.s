@@ -0,0 +1,42 @@
+    .text
+    .align    2
+    .globl    main
+main:
+    sw ra, -4(sp)
+    sw s0, -8(sp)
+    sw s1, -12(sp)
+    addi sp, sp, -32
+
+    li a0, 16
+    call malloc
+    mv s0, a0
+
+    # Grow by doubling, the block is at the top of heap
+    li s1, 32
+loop:
+    sw s1, 0(s0) # touch the first word
+    mv a0, s0
+    mv a1, s1
+    call realloc
+    bne a0, s0, fail
+    slli s1, s1, 1
+    li t0, 1048576
+    bne s1, t0, loop
+
+    la a0, .str.2
+end:
+    addi sp, sp, 32
+    lw s1, -12(sp)
+    lw s0, -8(sp)
+    lw ra, -4(sp)
+    tail puts
+
+fail:
+    la a0, .str.1
+    j end
+
+    .data
+.str.1:
+    .string     "fail_to_realloc_in_place"
+.str.2:
+    .string     "success"
@@ -0,0 +1,66 @@
+# Integers with many leading zeros, and integers too long for any type.
+    .text
+    .align    2
+    .globl    main
+main:
+    sw ra, -4(sp)
+    addi sp, sp, -16
+
+    # Leading zeros do not count as digits
+    la a0, .str.1
+    la a1, .str.fmt
+    addi a2, sp, 0
+    addi a3, sp, 4
+    call sscanf
+    lw t0, 0(sp)
+    li t1, 5
+    bne t0, t1, fail
+    lw t0, 4(sp)
+    li t1, -42
+    bne t0, t1, fail
+
+    # Only zeros is still zero
+    la a0, .str.2
+    la a1, .str.fmt
+    addi a2, sp, 0
+    addi a3, sp, 4
+    call sscanf
+    lw t0, 0(sp)
+    bnez t0, fail
+    lw t0, 4(sp)
+    li t1, 7
+    bne t0, t1, fail
+
+    # Too many significant digits overflow, and clamp
+    la a0, .str.3
+    la a1, .str.fmt
+    addi a2, sp, 0
+    addi a3, sp, 4
+    call sscanf
+    lw t0, 0(sp)
+    li t1, 0x7fffffff
+    bne t0, t1, fail
+
+    la a0, .str.ok
+end:
+    addi sp, sp, 16
+    lw ra, -4(sp)
+    tail puts
+
+fail:
+    la a0, .str.fail
+    j end
+
+    .data
+.str.1:
+    .string     "0000000000000000000000000000000000000005 -000000000000000000000000000000000000000042"
+.str.2:
+    .string     "000000000000000000000000000000000000000000 +0007"
+.str.3:
+    .string     "1000000000000000000000000000000000000000000005 1"
+.str.fmt:
+    .string     "%d %d"
+.str.ok:
+    .string     "success"
+.str.fail:
+    .string     "fail_to_scan"
@@ -0,0 +1,64 @@
+# An overlapping strcpy(buf, buf + 3), on a string longer than a block,
+# copies forward as if byte by byte.
+    .text
+    .align    2
+    .globl    main
+main:
+    sw ra, -4(sp)
+    sw s0, -8(sp)
+    addi sp, sp, -16
+
+    # buf[i] = 'a' + i % 26, for 200 bytes, and expected is buf + 3
+    la s0, buf
+    la t5, expected
+    li t0, 0
+    li t1, 200
+    li t2, 26
+fill:
+    remu t3, t0, t2
+    addi t3, t3, 'a'
+    add t4, s0, t0
+    sb t3, 0(t4)
+    addi t0, t0, 1
+    blt t0, t1, fill
+
+    li t0, 3
+copy:
+    add t4, s0, t0
+    lbu t3, 0(t4)
+    add t4, t5, t0
+    sb t3, -3(t4)
+    addi t0, t0, 1
+    blt t0, t1, copy
+
+    mv a0, s0
+    addi a1, s0, 3
+    call strcpy
+    bne a0, s0, fail
+
+    mv a0, s0
+    la a1, expected
+    call strcmp
+    bnez a0, fail
+
+    la a0, .str.ok
+end:
+    addi sp, sp, 16
+    lw s0, -8(sp)
+    lw ra, -4(sp)
+    tail puts
+
+fail:
+    la a0, .str.fail
+    j end
+
+    .data
+    .align    2
+buf:
+    .zero   208
+expected:
+    .zero   208
+.str.ok:
+    .string     "success"
+.str.fail:
+    .string     "fail_to_copy"
@@ -0,0 +1,135 @@
+# Strings around the chunk and block sizes of the string builtins, and longer
+# than a block. Each length goes through strlen, strcpy and strcmp, and the
+# mismatch is put at the last byte, past the first block for long strings.
+    .text
+    .align    2
+    .globl    main
+main:
+    sw ra, -4(sp)
+    sw s0, -8(sp)
+    sw s1, -12(sp)
+    sw s2, -16(sp)
+    addi sp, sp, -16
+
+    # src[i] = 'a' + i % 26
+    la s0, src
+    li t0, 0
+    li t1, 300
+    li t2, 26
+fill:
+    remu t3, t0, t2
+    addi t3, t3, 'a'
+    add t4, s0, t0
+    sb t3, 0(t4)
+    addi t0, t0, 1
+    blt t0, t1, fill
+
+    la s2, lengths
+loop:
+    lw s1, 0(s2)
+    bltz s1, success
+
+    # Cut src at the length, and fill dst with '*'
+    add t0, s0, s1
+    sb zero, 0(t0)
+    la a0, dst
+    li a1, '*'
+    li a2, 320
+    call memset
+
+    mv a0, s0
+    call strlen
+    bne a0, s1, fail
+
+    la a0, dst
+    mv a1, s0
+    call strcpy
+    la t0, dst
+    bne a0, t0, fail
+    call strlen
+    bne a0, s1, fail
+
+    # Nothing is written past the terminator
+    la t0, dst
+    add t0, t0, s1
+    lbu t1, 1(t0)
+    li t2, '*'
+    bne t1, t2, fail
+
+    la a0, dst
+    mv a1, s0
+    call strcmp
+    bnez a0, fail
+
+    # A mismatch at the last byte
+    beqz s1, next
+    la t0, dst
+    add t0, t0, s1
+    li t1, '~'
+    sb t1, -1(t0)
+    la a0, dst
+    mv a1, s0
+    call strcmp
+    blez a0, fail
+    mv a0, s0
+    la a1, dst
+    call strcmp
+    bgez a0, fail
+
+next:
+    # Restore the byte at the cut
+    li t2, 26
+    remu t3, s1, t2
+    addi t3, t3, 'a'
+    add t0, s0, s1
+    sb t3, 0(t0)
+    addi s2, s2, 4
+    j loop
+
+success:
+    la a0, .str.ok
+end:
+    addi sp, sp, 16
+    lw s2, -16(sp)
+    lw s1, -12(sp)
+    lw s0, -8(sp)
+    lw ra, -4(sp)
+    tail puts
+
+fail:
+    la a0, .str.fail
+    j end
+
+    .data
+    .align    2
+lengths:
+    .word   0
+    .word   1
+    .word   7
+    .word   8
+    .word   9
+    .word   15
+    .word   16
+    .word   17
+    .word   31
+    .word   32
+    .word   33
+    .word   63
+    .word   64
+    .word   65
+    .word   127
+    .word   128
+    .word   129
+    .word   200
+    .word   255
+    .word   256
+    .word   299
+    .word   -1
+src:
+    .zero   320
+dst:
+    .zero   320
+.str.ok:
+    .string     "success"
+.str.fail:
+    .string     "fail_on_long_strings"
@@ -13,6 +13,14 @@ local other_cxflags = {
     "-Wswitch-default",     -- warn if no default case in a switch statement
 }
 
+-- Threaded-code dispatch within blocks: xmake f --threaded=y
+option("threaded")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Chain block body commands to each other instead of returning to the interpreter loop")
+    add_defines("REIMU_THREADED")
+option_end()
+
 target("reimu")
     set_kind("binary")
     set_warnings(warnings)
@@ -23,6 +31,7 @@ target("reimu")
     set_toolchains("gcc")
     set_languages("c++23")
     add_packages("fmt")
+    add_options("threaded")
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io